@@ -0,0 +1,99 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * admission.c: Implementierung der Zugangskontrolle neuer Verbindungen
+ *
+ * Zu Beginn eines Turniers verbinden sich viele Clients gleichzeitig. Statt
+ * jeden abzuweisen, für den gerade kein Platz frei ist, wird er in eine
+ * begrenzte Warteschlange gestellt und später zum Login zugelassen, sobald ein
+ * Platz frei wird. Abgewiesen (Load Shedding) wird eine Verbindung nur, wenn die
+ * Warteschlange voll ist oder die Gesamtzahl der Verbindungen die Obergrenze
+ * erreicht hat.
+ * Ein Platz ist entweder durch einen angemeldeten Spieler oder durch einen
+ * laufenden Login belegt, diese Zahl übergibt das Login-Modul. Es gibt so viele
+ * Plätze wie in alle Räume passen.
+ */
+#include <stdlib.h>
+#include <pthread.h>
+#include "admission.h"
+#include "vardefine.h"
+#include "mutexhelper.h"
+#include "../common/util.h"
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static pthread_mutex_t admissionMutex;
+
+// Ring buffer of the waiting sockets in the order of their arrival
+static int *waitingSockets = NULL;
+static int waitingCapacity = 0;
+static int waitingHead = 0;
+static int waitingCount = 0;
+
+static int connectionLimit = 0;
+static int slotCapacity = 0;
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+int initAdmission(int capacity, int limit, int slots) {
+    if (mutexInit(&admissionMutex, NULL) < 0) {
+        errorPrint("Could not init admission MUTEX!");
+        return -1;
+    }
+
+    waitingSockets = malloc((size_t) (capacity > 0 ? capacity : 1) * sizeof(int));
+    if (waitingSockets == NULL) {
+        errorPrint("Could not allocate the waiting queue!");
+        return -2;
+    }
+    waitingCapacity = capacity;
+    connectionLimit = limit;
+    slotCapacity = slots;
+    return 0;
+}
+
+//return one of the ADMISSION_* decisions, a waiting connection is queued already
+int admitConnection(int clientSocket, int usedSlots) {
+    mutexLock(&admissionMutex);
+
+    int decision;
+    if (usedSlots + waitingCount >= connectionLimit) {
+        decision = ADMISSION_SHED;
+    } else if (usedSlots < slotCapacity && waitingCount == 0) {
+        // Nobody may overtake the connections that are waiting already
+        decision = ADMISSION_LOGIN;
+    } else if (waitingCount < waitingCapacity) {
+        waitingSockets[(waitingHead + waitingCount) % waitingCapacity] = clientSocket;
+        waitingCount++;
+        decision = ADMISSION_WAIT;
+    } else {
+        decision = ADMISSION_SHED;
+    }
+
+    mutexUnlock(&admissionMutex);
+    return decision;
+}
+
+//return the longest waiting socket if a slot is free, -1 otherwise
+int takeWaitingConnection(int usedSlots) {
+    mutexLock(&admissionMutex);
+
+    int clientSocket = -1;
+    if (usedSlots < slotCapacity && waitingCount > 0) {
+        clientSocket = waitingSockets[waitingHead];
+        waitingHead = (waitingHead + 1) % waitingCapacity;
+        waitingCount--;
+    }
+
+    mutexUnlock(&admissionMutex);
+    return clientSocket;
+}
+
+int getWaitingConnectionCount() {
+    return waitingCount;
+}
@@ -0,0 +1,26 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * admission.h: Header für die Zugangskontrolle neuer Verbindungen
+ */
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+enum {
+    ADMISSION_LOGIN = 1, // A slot is free, the login can start right away
+    ADMISSION_WAIT = 2, // The connection is queued until a slot gets free
+    ADMISSION_SHED = 3 // The connection has to be rejected
+};
+
+int initAdmission(int waitingCapacity, int connectionLimit, int slotCapacity);
+
+int admitConnection(int clientSocket, int usedSlots);
+
+int takeWaitingConnection(int usedSlots);
+
+int getWaitingConnectionCount();
+
+#endif
@@ -8,6 +8,8 @@
  *
  * Implementieren Sie in diesem Modul die Funktionen zum Start des Loaders,
  * zum Auflisten der Fragekataloge und zum Laden des gewählten Fragekataloges.
+ * Ein geladener Katalog ändert sich nicht mehr und wird von allen Räumen
+ * geteilt, die ihn spielen. Der Loader lädt jeden Katalog daher nur einmal.
  */
 #include <stddef.h>
 #include <unistd.h>
@@ -19,6 +21,17 @@
 #include "../common/server_loader_protocol.h"
 #include "../common/util.h"
 #include "catalog.h"
+#include "rfc.h"
+#include "mutexhelper.h"
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static LOADED_CATALOG *loadCatalogFromLoader(char catalogFile[]);
+
+static int encodeQuestionFrames(LOADED_CATALOG *catalog);
+
+static void releasePartialCatalog(LOADED_CATALOG *catalog);
 
 //------------------------------------------------------------------------------
 // Fields
@@ -29,8 +42,10 @@ static int pipeOutFD[2];
 static int catalogCount = 0;
 static CATALOG catalogs[CATALOGS_MAX_COUNT];
 
-static int loadedQuestionCount = -1;
-static Question *loadedQuestions;
+// The loader is used by the rooms one after the other, the loaded catalogs are kept until the exit
+static pthread_mutex_t loaderMutex = PTHREAD_MUTEX_INITIALIZER;
+static LOADED_CATALOG *loadedCatalogs[CATALOGS_MAX_COUNT];
+static int loadedCatalogCount = 0;
 
 //------------------------------------------------------------------------------
 // Implementations
@@ -122,7 +137,35 @@ int fetchBrowseCatalogs() {
     return 0;
 }
 
-int loadCatalog(char catalogFile[]) {
+//return the catalog, it is loaded if no room has played it yet, NULL on error
+LOADED_CATALOG *loadCatalog(char catalogFile[]) {
+    mutexLock(&loaderMutex);
+    LOADED_CATALOG *catalog = NULL;
+    for (int i = 0; i < loadedCatalogCount; i++) {
+        if (strncmp(loadedCatalogs[i]->name, catalogFile, CATALOG_FILENAME_SIZE) == 0) {
+            catalog = loadedCatalogs[i];
+        }
+    }
+    if (catalog == NULL && loadedCatalogCount < CATALOGS_MAX_COUNT) {
+        catalog = loadCatalogFromLoader(catalogFile);
+        if (catalog != NULL) {
+            loadedCatalogs[loadedCatalogCount++] = catalog;
+        }
+    }
+    mutexUnlock(&loaderMutex);
+    return catalog;
+}
+
+//return the encoded question or the empty question if the index is behind the last question
+WIRE_FRAME *getQuestionFrame(LOADED_CATALOG *catalog, int index) {
+    if (index < 0 || index >= catalog->questionCount) {
+        return catalog->questionFrames[catalog->questionCount];
+    }
+    return catalog->questionFrames[index];
+}
+
+//The loader mutex has to be locked
+static LOADED_CATALOG *loadCatalogFromLoader(char catalogFile[]) {
     // NOTE
     // Workaround, because the loaded has a read or write buffer in "queue".
     // Without this we cannot read or write correctly!!!
@@ -132,13 +175,13 @@ int loadCatalog(char catalogFile[]) {
 
 
     // Send load cmd to load shared memory
-    size_t cmdLength = strlen(LOAD_CMD_PREFIX) + strlen(catalogFile) + strlen(SEND_CMD);
+    size_t cmdLength = strlen(LOAD_CMD_PREFIX) + strnlen(catalogFile, CATALOG_FILENAME_SIZE) + strlen(SEND_CMD) + 1;
     char cmd[cmdLength];
-    sprintf(cmd, "%s%s%s", LOAD_CMD_PREFIX, catalogFile, SEND_CMD);
-    infoPrint("Sending \"%s%s\" command to loader.", LOAD_CMD_PREFIX, catalogFile);
+    snprintf(cmd, cmdLength, "%s%.*s%s", LOAD_CMD_PREFIX, CATALOG_FILENAME_SIZE, catalogFile, SEND_CMD);
+    infoPrint("Sending \"%s%.*s\" command to loader.", LOAD_CMD_PREFIX, CATALOG_FILENAME_SIZE, catalogFile);
     if (write(pipeInFD[1], cmd, strlen(cmd)) != strlen(cmd)) {
         errorPrint("Error sending load command to pipe.");
-        return -1;
+        return NULL;
     }
 
     // Read response from loader
@@ -147,22 +190,28 @@ int loadCatalog(char catalogFile[]) {
 
     if (strncmp(LOAD_SUCCESS_PREFIX, response, strlen(LOAD_SUCCESS_PREFIX)) != 0) {
         errorPrint("Loader failure message: %s", response);
-        return -2;
+        return NULL;
     }
 
-    char loadedCategoriesCountString[10];
-    memcpy(loadedCategoriesCountString, &response[strlen(LOAD_SUCCESS_PREFIX)], strlen(response) * sizeof(char));
-    loadedQuestionCount = atoi(loadedCategoriesCountString);
+    LOADED_CATALOG *catalog = calloc(1, sizeof(LOADED_CATALOG));
+    if (catalog == NULL) {
+        errorPrint("Could not allocate the catalog.");
+        return NULL;
+    }
+    strncpy(catalog->name, catalogFile, CATALOG_FILENAME_SIZE - 1);
+    catalog->questionCount = atoi(&response[strlen(LOAD_SUCCESS_PREFIX)]);
 
     // Open shared memory handle
     int handle = shm_open(SHMEM_NAME, O_RDONLY, 0600);
     if (handle < 0) {
         errorPrint("Could not open shared memory (%s).", SHMEM_NAME);
-        return -3;
+        free(catalog);
+        return NULL;
     }
 
     // Load questions
-    loadedQuestions = mmap(NULL, loadedQuestionCount * sizeof(Question), PROT_READ, MAP_SHARED, handle, 0);
+    catalog->questions = mmap(NULL, catalog->questionCount * sizeof(Question), PROT_READ, MAP_SHARED, handle, 0);
+    close(handle);
 
     // Delete the shared memory for future uses
     int deleteShMem = shm_unlink(SHMEM_NAME);
@@ -170,13 +219,49 @@ int loadCatalog(char catalogFile[]) {
         errorPrint("Could not delete shared memory.");
     }
 
-    return 0;
+    if (catalog->questions == MAP_FAILED || encodeQuestionFrames(catalog) < 0) {
+        errorPrint("Could not encode the questions.");
+        releasePartialCatalog(catalog);
+        return NULL;
+    }
+
+    return catalog;
 }
 
-int getLoadedQuestionCount() {
-    return loadedQuestionCount;
+// The questions never change after loading, so they are only encoded once.
+// The additional last entry is the empty question that tells a player that all questions are done.
+static int encodeQuestionFrames(LOADED_CATALOG *catalog) {
+    catalog->questionFrames = calloc((size_t) catalog->questionCount + 1, sizeof(WIRE_FRAME *));
+    if (catalog->questionFrames == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < catalog->questionCount; i++) {
+        Question *question = &catalog->questions[i];
+        MESSAGE message = buildQuestion(question->question, question->answers, question->timeout);
+        catalog->questionFrames[i] = encodeMessage(&message);
+        if (catalog->questionFrames[i] == NULL) {
+            return -2;
+        }
+    }
+    MESSAGE emptyMessage = buildQuestionEmpty();
+    catalog->questionFrames[catalog->questionCount] = encodeMessage(&emptyMessage);
+    if (catalog->questionFrames[catalog->questionCount] == NULL) {
+        return -3;
+    }
+    return 0;
 }
 
-Question *getLoadedQuestions() {
-    return loadedQuestions;
+// Frees what a failed load had already set up, the frames that were not encoded yet are NULL
+static void releasePartialCatalog(LOADED_CATALOG *catalog) {
+    if (catalog->questionFrames != NULL) {
+        for (int i = 0; i <= catalog->questionCount; i++) {
+            releaseWireFrame(catalog->questionFrames[i]);
+        }
+        free(catalog->questionFrames);
+    }
+    if (catalog->questions != MAP_FAILED) {
+        munmap(catalog->questions, catalog->questionCount * sizeof(Question));
+    }
+    free(catalog);
 }
@@ -10,6 +10,7 @@
 #define CATALOG_H
 
 #include "../common/question.h"
+#include "sendqueue.h"
 
 #define SEND_CMD "\n"
 #define CATALOG_FILENAME_SIZE 32
@@ -20,6 +21,13 @@ typedef struct {
     char name[CATALOG_FILENAME_SIZE];
 } CATALOG;
 
+typedef struct {
+    char name[CATALOG_FILENAME_SIZE];
+    int questionCount;
+    Question *questions;
+    WIRE_FRAME **questionFrames; // The last one is the empty question
+} LOADED_CATALOG;
+
 int getCatalogCount();
 
 char *getCatalogNameByIndex(int index);
@@ -28,10 +36,8 @@ int createCatalogChildProcess(char *catalogPath, char *loaderPath);
 
 int fetchBrowseCatalogs();
 
-int loadCatalog(char catalogFile[]);
-
-int getLoadedQuestionCount();
+LOADED_CATALOG *loadCatalog(char catalogFile[]);
 
-Question* getLoadedQuestions();
+WIRE_FRAME *getQuestionFrame(LOADED_CATALOG *catalog, int index);
 
 #endif
@@ -4,12 +4,28 @@
  *
  * Server
  *
- * clientthread.c: Implementierung des Client-Threads
+ * clientthread.c: Implementierung der Client-Behandlung
  *
- * In diesem Modul wird die an phread_create(3) übergebene Threadfunktion für
- * den Client-Thread implementiert. Bitte nutzen Sie modulgebundene (static)
- * Hilfsfunktionen, um die Implementierung übersichtlich zu halten und
- * schreiben Sie nicht alles in eine einzige große Funktion.
+ * In diesem Modul werden die Nachrichten der Clients behandelt. Diese werden
+ * nicht mehr von einem eigenen Thread pro Client empfangen, sondern vom Reactor
+ * (siehe reactor.c) an handleClientMessage() übergeben.
+ * Der Weg eines Spielers durch die Fragen ist eine stacklose Koroutine pro
+ * Spieler (siehe coroutine.h): Sie wartet auf die Fragenanforderung, sendet die
+ * Frage und wartet dann auf die Antwort oder den Timeout. Nachrichten und
+ * Timer setzen sie nur mit ihrem Ereignis fort, einer nach dem anderen.
+ * Reactoren und Timer behandeln dabei nichts selbst: Sie legen Befehle in den
+ * Briefkasten des Raumes, dessen Aktor (siehe roomactor.h) sie ausführt.
+ * Jeder Raum (siehe room.h) hat seinen eigenen Spielzustand, ein beendetes
+ * Spiel beendet nur seinen Raum und nicht mehr den Server. Die Spieler eines
+ * beendeten Spiels kehren in die Vorbereitung zurück, der Spielleiter kann
+ * mit dem geladenen Katalog gleich das nächste Spiel starten.
+ * Im Modus mit synchronen Runden gibt es statt der Koroutinen nur einen Timer
+ * pro Raum: Alle Spieler bekommen Frage k zugleich als denselben vorab
+ * kodierten Frame, die Runde endet, wenn alle geantwortet haben oder die Frist
+ * des Raumes abläuft.
+ * Bitte nutzen Sie modulgebundene (static) Hilfsfunktionen, um die
+ * Implementierung übersichtlich zu halten und schreiben Sie nicht alles in
+ * eine einzige große Funktion.
  * Verwenden Sie zum Senden und Empfangen von Nachrichten die von Ihnen
  * definierten Funktionen und Strukturen aus dem RFC-Modul.
  * Benutzen Sie für den Zugriff auf die User-Liste das Modul user.
@@ -34,159 +50,225 @@
 #include "rfchelper.h"
 #include "usertimer.h"
 #include "mutexhelper.h"
+#include "reactor.h"
+#include "coroutine.h"
+#include "room.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+enum {
+    SESSION_EVENT_QUESTION_REQUEST = 1,
+    SESSION_EVENT_QUESTION_ANSWERED = 2,
+    SESSION_EVENT_QUESTION_TIMEOUT = 3
+};
 
 //------------------------------------------------------------------------------
 // Method pre-declaration
 //------------------------------------------------------------------------------
-void *clientThread(void *userIdPtr);
+static void postClientMessage(int userId, MESSAGE *message);
+
+static void postDisconnect(int userId);
+
+static void postQuestionTimeout(int userId);
+
+static void postRoundTimeout(int roomId);
+
+static void postUserCommand(int type, int userId, /* nullable */ MESSAGE *message);
+
+static void handleRoomCommand(ROOM_COMMAND *command);
+
+static void handleClientMessage(int userId, MESSAGE *message);
 
 static int isMessageTypeAllowedInCurrentGameState(int gameState, int messageType);
 
 static int isUserAuthorizedForMessageType(int messageType, int userId);
 
-static void checkAndHandleAllPlayersFinished();
+static void checkAndHandleAllPlayersFinished(ROOM *room);
 
-static void checkAndHandleGameEnd();
+static void checkAndHandleGameEnd(ROOM *room);
+
+static void returnToLobby(ROOM *room);
+
+static void resetPlayerSessions(ROOM *room);
 
 static void handleConnectionTimeout(int userId);
 
 static void handleCatalogRequest(int userId);
 
-static void handleCatalogChange(MESSAGE *message);
+static void handleCatalogChange(MESSAGE *message, int userId);
 
 static void handleStartGame(MESSAGE *message, int userId);
 
-static void handleQuestionRequest(int userId);
+static void resumePlayerSession(int userId, int event, /* nullable */ MESSAGE *message);
 
-static void handleQuestionAnswered(MESSAGE *message, int userId);
+static int runPlayerSession(int userId, ROOM *room, PLAYER_SESSION *session);
 
-static void handleQuestionTimeout(int userId);
+static void sendQuestion(int userId, ROOM *room, int questionIndex);
 
-static void finalizeQuestionHandling(int userId, int inTime, Question *question);
+static void finishQuestion(int userId, ROOM *room, PLAYER_SESSION *session);
 
-//------------------------------------------------------------------------------
-// Fields
-//------------------------------------------------------------------------------
-static pthread_mutex_t threadCreationMutex;
-static int threadCreationUserId;
+static void startRound(ROOM *room, int round);
 
-static int currentGameState;
+static void handleRoundAnswer(int userId, ROOM *room, MESSAGE *message);
 
-static pthread_t clientThreadId[MAXUSERS] = {0};
+static void handleRoundTimeout(ROOM *room);
 
-static char *selectedCatalogName = NULL;
-static pthread_mutex_t selectedCatalogNameMutex;
+static void leaveRound(ROOM *room, int answered);
 
-static int currentQuestion[MAXUSERS] = {0};
+static void endRound(ROOM *room);
 
-static int finishedPlayerCount = 0;
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static int synchronizedRounds = 0; // All players of a room get the questions at the same time
 
 //------------------------------------------------------------------------------
 // Implementations
 //------------------------------------------------------------------------------
-int initializeClientThreadModule() {
-    // Initialize mutexes
-    int threadCreationMutexResult = mutexInit(&threadCreationMutex, NULL);
-    if (threadCreationMutexResult < 0) {
-        errorPrint("Could not init thread creation MUTEX!");
-        return threadCreationMutexResult;
+int initializeClientThreadModule(int reactorBackend, int reactorCount, int actorCount, int slowConsumerPolicy,
+                                 int synchronized) {
+    synchronizedRounds = synchronized;
+
+    // The actors run the game logic of the rooms, the reactors only hand them what they receive
+    int actorResult = startRoomActors(actorCount, handleRoomCommand);
+    if (actorResult < 0) {
+        errorPrint("Could not start the room actors!");
+        return actorResult;
+    }
+
+    // Start the reactor threads, that receive the messages of all clients
+    int reactorResult = startReactors(reactorBackend, reactorCount, slowConsumerPolicy, postClientMessage,
+                                      postDisconnect);
+    if (reactorResult < 0) {
+        errorPrint("Could not start the reactors!");
+        return reactorResult;
     }
-    int catalogMutexResult = mutexInit(&selectedCatalogNameMutex, NULL);
-    if (catalogMutexResult < 0) {
-        errorPrint("Could not init selected catalog name MUTEX!");
-        return catalogMutexResult;
+
+    return 0;
+}
+
+//A user taken over from a previous server brings what it has received already
+int startClientHandling(int userId, /* nullable */ RECEIVE_BUFFER *received) {
+    // The reactor does not know the socket yet, so the actor cannot run the session meanwhile
+    PLAYER_SESSION *session = &getSeat(getRoom(getRoomIdOfUser(userId)), getSeatOfUser(userId))->session;
+    CO_RESET(&session->coroutine);
+
+    int result = reactorAddClient(getUser(userId).clientSocket, userId, received);
+    if (result < 0) {
+        errorPrint("Can't hand over user %d to the reactor!", userId);
+        return result;
     }
 
+    infoPrint("Client handling for user %d started successfully.", userId);
     return 0;
 }
 
-int startClientThread(int userId) {
-    // NOTE Remove this print when the workaround below is fixed
-    errorPrint("START CLIENT-THREAD USER-ID: %i", userId);
-
-    // NOTE Workaround: If we start 2 clients at once, the function clientThread is sometimes called
-    // with the same user id (of the second client) and so nothing is working anymore.
-    // To fix this we use a mutex to create only one thread at once and get the user id before
-    // releasing the mutex
-    mutexLock(&threadCreationMutex);
-    threadCreationUserId = userId;
-
-    // Create thread
-    int err = pthread_create(&clientThreadId[userId], NULL, clientThread, &userId);
-    registerThread(clientThreadId[userId]);
-    if (clientThreadId[userId] == 0 || err == 0) {
-        infoPrint("Client thread created successfully.");
-    } else {
-        errorPrint("Can't create client thread!");
-        // NOTE See workaround above
-        mutexUnlock(&threadCreationMutex);
-    }
-    return err;
+static void postClientMessage(int userId, MESSAGE *message) {
+    postUserCommand(ROOM_COMMAND_MESSAGE, userId, message);
+}
+
+static void postDisconnect(int userId) {
+    // The reactor must not report the socket again, the rest of the disconnect runs in the actor of the room
+    reactorRemoveClient(getUser(userId).clientSocket);
+    postUserCommand(ROOM_COMMAND_DISCONNECT, userId, NULL);
+}
+
+static void postQuestionTimeout(int userId) {
+    postUserCommand(ROOM_COMMAND_QUESTION_TIMEOUT, userId, NULL);
+}
+
+static void postRoundTimeout(int roomId) {
+    if (postRoomCommand(ROOM_COMMAND_ROUND_TIMEOUT, roomId, -1, -1, NULL) < 0) {
+        errorPrint("Could not pass the round timeout to room %d!", roomId);
+    }
+}
+
+static void postUserCommand(int type, int userId, /* nullable */ MESSAGE *message) {
+    if (postRoomCommand(type, getRoomIdOfUser(userId), userId, getUser(userId).clientSocket, message) < 0) {
+        errorPrint("Could not pass command %d of user %d to its room!", type, userId);
+    }
+}
+
+//Runs in the actor of the room, one command after the other
+static void handleRoomCommand(ROOM_COMMAND *command) {
+    if (command->type == ROOM_COMMAND_ROUND_TIMEOUT) {
+        handleRoundTimeout(getRoom(command->roomId));
+        return;
+    }
+
+    // The user may have left since the command was posted, then its id or seat may belong to someone else
+    if (getRoomIdOfUser(command->userId) != command->roomId
+        || !isUserOnSocket(command->userId, command->clientSocket)) {
+        debugPrint("Dropping command %d of user %d that has left room %d", command->type, command->userId,
+                   command->roomId);
+        return;
+    }
+
+    switch (command->type) {
+        case ROOM_COMMAND_MESSAGE:
+            handleClientMessage(command->userId, &command->message);
+            break;
+        case ROOM_COMMAND_DISCONNECT:
+            handleConnectionTimeout(command->userId);
+            break;
+        case ROOM_COMMAND_QUESTION_TIMEOUT:
+            resumePlayerSession(command->userId, SESSION_EVENT_QUESTION_TIMEOUT, NULL);
+            break;
+        default:
+            break;
+    }
 }
 
-void *clientThread(void *userIdPtr) {
-    int userId = *(int *) userIdPtr;
-    // NOTE Remove this print when the workaround below is fixed
-    errorPrint("STARTED CLIENT-THREAD USER-ID: %i", userId);
-
-    // NOTE See workaround in startClientThread()
-    if(userId != threadCreationUserId) {
-        errorPrint("===============================================================================");
-        errorPrint("==================================== ERROR ====================================");
-        errorPrint("===============================================================================");
-    }
-    userId = threadCreationUserId;
-    mutexUnlock(&threadCreationMutex);
-
-    if (isGameLeader(userId) >= 0) {
-        currentGameState = GAME_STATE_PREPARATION;
-    }
-
-    while (1) {
-        MESSAGE message;
-        ssize_t messageSize = receiveMessage(getUser(userId).clientSocket, &message);
-        if (messageSize > 0 && currentGameState != GAME_STATE_ABORTED) {
-            if (validateMessage(&message) >= 0) {
-                if (isMessageTypeAllowedInCurrentGameState(currentGameState, message.header.type) < 0) {
-                    errorPrint("User %d not allowed to send RFC type %d in current game state: %d!", userId,
-                               message.header.type, currentGameState);
-                    continue;
-                }
-
-                if (isUserAuthorizedForMessageType(userId, message.header.type) < 0) {
-                    errorPrint("User %d not allowed to send RFC type %d!", userId, message.header.type);
-                    continue;
-                }
-
-                switch (message.header.type) {
-                    case TYPE_CATALOG_REQUEST:
-                        handleCatalogRequest(userId);
-                        break;
-                    case TYPE_CATALOG_CHANGE:
-                        handleCatalogChange(&message);
-                        break;
-                    case TYPE_START_GAME:
-                        handleStartGame(&message, userId);
-                        break;
-                    case TYPE_QUESTION_REQUEST:
-                        handleQuestionRequest(userId);
-                        break;
-                    case TYPE_QUESTION_ANSWERED:
-                        handleQuestionAnswered(&message, userId);
-                        break;
-                    default:
-                        // Do nothing
-                        break;
-                }
+static void handleClientMessage(int userId, MESSAGE *message) {
+    ROOM *room = getRoom(getRoomIdOfUser(userId));
+    if (room->gameState == GAME_STATE_ABORTED) {
+        handleConnectionTimeout(userId);
+        return;
+    }
+
+    if (validateMessage(message) < 0) {
+        errorPrint("Invalid RFC message!");
+        return;
+    }
+
+    if (isMessageTypeAllowedInCurrentGameState(room->gameState, message->header.type) < 0) {
+        errorPrint("User %d not allowed to send RFC type %d in current game state: %d!", userId,
+                   message->header.type, room->gameState);
+        return;
+    }
+
+    if (isUserAuthorizedForMessageType(message->header.type, userId) < 0) {
+        errorPrint("User %d not allowed to send RFC type %d!", userId, message->header.type);
+        return;
+    }
+
+    switch (message->header.type) {
+        case TYPE_CATALOG_REQUEST:
+            handleCatalogRequest(userId);
+            break;
+        case TYPE_CATALOG_CHANGE:
+            handleCatalogChange(message, userId);
+            break;
+        case TYPE_START_GAME:
+            handleStartGame(message, userId);
+            break;
+        case TYPE_QUESTION_REQUEST:
+            // The room decides when the next question comes in synchronized rounds
+            if (!synchronizedRounds) {
+                resumePlayerSession(userId, SESSION_EVENT_QUESTION_REQUEST, NULL);
+            }
+            break;
+        case TYPE_QUESTION_ANSWERED:
+            if (synchronizedRounds) {
+                handleRoundAnswer(userId, room, message);
             } else {
-                errorPrint("Invalid RFC message!");
+                resumePlayerSession(userId, SESSION_EVENT_QUESTION_ANSWERED, message);
             }
-        } else if (messageSize == 0 || currentGameState == GAME_STATE_ABORTED) {
-            handleConnectionTimeout(userId);
-            return NULL; // Safe call to terminate loop
-        } else {
-            errorPrint("Error receiving message (message size: %zu)!", messageSize);
-        }
+            break;
+        default:
+            // Do nothing
+            break;
     }
 }
 
@@ -203,78 +285,137 @@ static int isUserAuthorizedForMessageType(int messageType, int userId) {
            ? 1 : -1;
 }
 
-static void checkAndHandleAllPlayersFinished() {
-    if (finishedPlayerCount == getUserAmount()) {
-        currentGameState = GAME_STATE_FINISHED;
-
-        infoPrint("Game over!");
-        lockUserData();
-        for (int i = 0; i < getUserAmount(); i++) {
-            USER user = getUserByIndex(i);
-            MESSAGE gameOver = buildGameOver(
-                    (uint8_t) getAndCalculateRankByUserId(user.id),
-                    (uint32_t) user.score);
-            if (sendMessage(user.clientSocket, &gameOver) < 0) {
-                errorPrint("Unable to send game over to %s (%d)",
-                           user.username,
-                           user.id);
-            }
+static void checkAndHandleAllPlayersFinished(ROOM *room) {
+    lockRoom(room->id);
+    // Players that have left after their last question still count as finished
+    if (room->gameState != GAME_STATE_GAME_RUNNING || room->finishedPlayerCount < room->userAmount) {
+        unlockRoom(room->id);
+        return;
+    }
+    room->gameState = GAME_STATE_FINISHED;
+    // The ranks have to include the points of the last answers
+    collectScores(room->id);
+    ROSTER *roster = acquireRoster(room->id);
+    unlockRoom(room->id);
+
+    // The roster is sorted by score, players with the same score share a rank
+    infoPrint("Game over in room %d!", room->id);
+    int rank = 0;
+    for (int i = 0; roster != NULL && i < roster->playerCount; i++) {
+        PLAYER *player = &roster->players[i];
+        ROSTER_MEMBER *member = &roster->members[i];
+        if (i == 0 || player->score != roster->players[i - 1].score) {
+            rank = i + 1;
+        }
+        if (!isUserOnSocket(member->userId, member->clientSocket)) {
+            continue;
         }
-        unlockUserData();
+        MESSAGE gameOver = buildGameOver((uint8_t) rank, player->score);
+        if (sendMessage(member->clientSocket, &gameOver) < 0) {
+            errorPrint("Unable to send game over to %s (%d)",
+                       player->name,
+                       member->userId);
+        }
+    }
+    releaseRoster(roster);
 
-        checkAndHandleGameEnd();
+    checkAndHandleGameEnd(room);
+}
+
+static void checkAndHandleGameEnd(ROOM *room) {
+    if (room->gameState == GAME_STATE_FINISHED) {
+        returnToLobby(room);
+    }
+    if (room->gameState == GAME_STATE_FINISHED || room->gameState == GAME_STATE_ABORTED) {
+        // Only the room is over, an aborted one gets free again when its last player has left.
+        // A server that has handed its lobby to a successor exits after its last game.
+        infoPrint("Game in room %d is over", room->id);
+        checkLoginRetirement();
     }
 }
 
-static void checkAndHandleGameEnd() {
-    if (currentGameState == GAME_STATE_FINISHED || currentGameState == GAME_STATE_ABORTED) {
-        // Cancel main thread so the server gets shut down
-        cancelMainThread();
+//The players stay in the room and the loaded catalog stays selected for the next game
+static void returnToLobby(ROOM *room) {
+    lockRoom(room->id);
+    // The lobby of a retired server belongs to the successor, its players only look at their results.
+    // The room lock orders this with the collection of the lobby users in retireLogin().
+    if (room->gameState != GAME_STATE_FINISHED || isLoginRetired()) {
+        unlockRoom(room->id);
+        return;
+    }
 
-        // NOTE We could also use other methods to reset the server in the initial state instead of
-        // shutting down
+    if (!isSeatTaken(room, 0)) {
+        // Nobody could start the next game
+        MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL, "Game leader has left the game.");
+        broadcastMessage(room->id, &errorWarning, "Unable to send error warning to %s (%d)!");
+        room->gameState = GAME_STATE_ABORTED;
+        unlockRoom(room->id);
+        return;
     }
+
+    room->gameState = GAME_STATE_PREPARATION;
+    // The catalog change shows the lobby again with the catalog just played, it is loaded already.
+    // The score agent keeps sending the final scores until the next start.
+    memcpy(room->selectedCatalogName, room->catalog->name, CATALOG_FILENAME_SIZE);
+    MESSAGE catalogChange = buildCatalogChange(room->selectedCatalogName);
+    broadcastMessage(room->id, &catalogChange, "Unable to send catalog change to %s (%d)!");
+    unlockRoom(room->id);
+    infoPrint("Room %d is back in preparation", room->id);
+    notifyScoreAgent(room->id);
 }
 
 static void handleConnectionTimeout(int userId) {
-    if (currentGameState != GAME_STATE_FINISHED) {
-        errorPrint("Player %d has left the game!", userId);
+    ROOM *room = getRoom(getRoomIdOfUser(userId));
+    lockRoom(room->id);
+    int gameState = room->gameState;
+    if (gameState != GAME_STATE_FINISHED) {
+        errorPrint("Player %d has left the game in room %d!", getSeatOfUser(userId), room->id);
     }
 
-    if (isGameLeader(userId) >= 0 && currentGameState == GAME_STATE_PREPARATION) {
+    if (isGameLeader(userId) >= 0 && gameState == GAME_STATE_PREPARATION) {
         MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL, "Game leader has left the game.");
-        broadcastMessageExcludeOneUser(&errorWarning, "Unable to send error warning to %s (%d)!", userId, 1);
+        broadcastMessageExcludeOneUser(room->id, &errorWarning, "Unable to send error warning to %s (%d)!", userId);
 
-        currentGameState = GAME_STATE_ABORTED;
-        checkAndHandleGameEnd();
-    } else if (getUserAmount() - 1 < MINUSERS && currentGameState == GAME_STATE_GAME_RUNNING) {
+        room->gameState = GAME_STATE_ABORTED;
+    } else if (getUserAmount(room->id) - 1 < MINUSERS && gameState == GAME_STATE_GAME_RUNNING) {
         char *errorTextPlain = "Game cancelled because there are less than %d players left.";
-        char *errorText = malloc(sizeof(errorTextPlain) + sizeof(MINUSERS));
-        sprintf(errorText, errorTextPlain, MINUSERS);
+        char errorText[RFC_ERROR_WARNING_MAX_LENGTH];
+        snprintf(errorText, sizeof(errorText), errorTextPlain, MINUSERS);
 
         MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL, errorText);
-        broadcastMessageExcludeOneUser(&errorWarning, "Unable to send error warning to %s (%d)!", userId, 1);
+        broadcastMessageExcludeOneUser(room->id, &errorWarning, "Unable to send error warning to %s (%d)!", userId);
 
-        currentGameState = GAME_STATE_ABORTED;
-        checkAndHandleGameEnd();
+        room->gameState = GAME_STATE_ABORTED;
+    }
+    unlockRoom(room->id);
+    if (room->gameState != gameState) {
+        checkAndHandleGameEnd(room);
     }
 
-    // Just to be safe call the close of the socket (if it is not closed yet)
+    // Stop watching the socket before closing it, because the descriptor may be reused at once
     infoPrint("Closing socket for user %d...", userId);
+    reactorRemoveClient(getUser(userId).clientSocket);
     close(getUser(userId).clientSocket);
 
+    // The id goes to the next user that logs in, so its timer must not fire anymore
+    stopTimer(userId);
+
+    int answered = getSeat(room, getSeatOfUser(userId))->session.answeredRound == room->round;
     infoPrint("Removing user data for user %d...", userId);
     removeUser(userId);
+    if (synchronizedRounds) {
+        leaveRound(room, answered);
+    }
 
-    // In case the game is finished we should now handle the case the game may be finished
-    checkAndHandleAllPlayersFinished();
+    // The slot of the user is free again for a waiting connection
+    admitWaitingConnections();
 
-    infoPrint("Exiting client thread for user %d...", userId);
-    unregisterThread(pthread_self());
-    pthread_exit(0);
+    // In case the game is finished we should now handle the case the game may be finished
+    checkAndHandleAllPlayersFinished(room);
 }
 
 static void handleCatalogRequest(int userId) {
+    int roomId = getRoomIdOfUser(userId);
     for (int i = 0; i < getCatalogCount(); i++) {
         MESSAGE catalogResponse = buildCatalogResponse(getCatalogNameByIndex(i));
         if (sendMessage(getUser(userId).clientSocket, &catalogResponse) < 0) {
@@ -286,8 +427,9 @@ static void handleCatalogRequest(int userId) {
         // We need to send a catalog change after the catalog request for new user to get the
         // selected catalog immediately and not have to wait for a catalog change
         // by the game leader
-        mutexLock(&selectedCatalogNameMutex);
-        if (selectedCatalogName != NULL && strlen(selectedCatalogName) > 0) {
+        lockRoom(roomId);
+        char *selectedCatalogName = getRoom(roomId)->selectedCatalogName;
+        if (strlen(selectedCatalogName) > 0) {
             MESSAGE catalogChange = buildCatalogChange(selectedCatalogName);
             if (sendMessage(getUser(userId).clientSocket, &catalogChange) < 0) {
                 errorPrint("Unable to send catalog change (after catalog response) to %s (%d)!",
@@ -295,25 +437,30 @@ static void handleCatalogRequest(int userId) {
                            getUser(userId).id);
             }
         }
-        mutexUnlock(&selectedCatalogNameMutex);
+        unlockRoom(roomId);
     }
 }
 
-static void handleCatalogChange(MESSAGE *message) {
-    mutexLock(&selectedCatalogNameMutex);
-    // NOTE FEEDBACK We should use memcpy, but this crashes
-    //memcpy(selectedCatalogName, message.body.catalogChange.fileName, strlen(message.body.catalogChange.fileName));
-    selectedCatalogName = message->body.catalogChange.fileName;
-    mutexUnlock(&selectedCatalogNameMutex);
-
-    MESSAGE catalogChangeResponse = buildCatalogChange(message->body.catalogChange.fileName);
-    broadcastMessage(&catalogChangeResponse, "Unable to send catalog change response to user %s (%d)!");
+static void handleCatalogChange(MESSAGE *message, int userId) {
+    int roomId = getRoomIdOfUser(userId);
+    lockRoom(roomId);
+    // The message is gone after handling, so the room keeps its own copy of the name
+    char *selectedCatalogName = getRoom(roomId)->selectedCatalogName;
+    memcpy(selectedCatalogName, message->body.catalogChange.fileName, CATALOG_FILENAME_SIZE);
+    selectedCatalogName[CATALOG_FILENAME_SIZE - 1] = '\0';
+
+    MESSAGE catalogChangeResponse = buildCatalogChange(selectedCatalogName);
+    broadcastMessage(roomId, &catalogChangeResponse,
+                     "Unable to send catalog change response to user %s (%d)!");
+    unlockRoom(roomId);
 }
 
 static void handleStartGame(MESSAGE *message, int userId) {
-    lockUserData();
+    int roomId = getRoomIdOfUser(userId);
+    ROOM *room = getRoom(roomId);
+    lockRoom(roomId);
 
-    if (getUserAmount() < MINUSERS) {
+    if (getUserAmount(roomId) < MINUSERS) {
         MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_WARNING,
                                                  "Cannot start game because there are too few participants!");
         if (sendMessage(getUser(userId).clientSocket, &errorWarning) < 0) {
@@ -321,96 +468,250 @@ static void handleStartGame(MESSAGE *message, int userId) {
                        getUser(userId).username,
                        getUser(userId).id);
         }
-        unlockUserData();
+        unlockRoom(roomId);
+        return;
+    }
+
+    if (isLoginRetired()) {
+        MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_WARNING,
+                                                 "Server is being upgraded, please start the game again!");
+        if (sendMessage(getUser(userId).clientSocket, &errorWarning) < 0) {
+            errorPrint("Unable to send error warning to %s (%d)!",
+                       getUser(userId).username,
+                       getUser(userId).id);
+        }
+        unlockRoom(roomId);
         return;
     }
 
-    disableLogin();
-    if (loadCatalog(message->body.startGame.catalog) < 0) {
-        currentGameState = GAME_STATE_ABORTED;
-        checkAndHandleGameEnd();
+    // Rooms that play the same catalog share it
+    room->catalog = loadCatalog(message->body.startGame.catalog);
+    if (room->catalog == NULL) {
+        MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL, "Catalog could not be loaded.");
+        broadcastMessage(roomId, &errorWarning, "Unable to send error warning to %s (%d)!");
+        room->gameState = GAME_STATE_ABORTED;
+        unlockRoom(roomId);
+        checkAndHandleGameEnd(room);
         return;
     }
-    currentGameState = GAME_STATE_GAME_RUNNING;
+    // A room that has played before starts its players from scratch
+    resetScores(roomId);
+    resetPlayerSessions(room);
+    room->finishedPlayerCount = 0;
+    room->gameState = GAME_STATE_GAME_RUNNING;
 
     MESSAGE startGameResponse = buildStartGame(message->body.startGame.catalog);
-    broadcastMessageWithoutLock(&startGameResponse, "Unable to send start game response to user %s (%d)!");
+    broadcastMessage(roomId, &startGameResponse, "Unable to send start game response to user %s (%d)!");
+
+    unlockRoom(roomId);
+    notifyScoreAgent(roomId);
+
+    if (synchronizedRounds) {
+        startRound(room, 0);
+    }
+}
 
-    unlockUserData();
-    notifyScoreAgent();
+//Runs in the actor of the room, the room has to be locked
+static void resetPlayerSessions(ROOM *room) {
+    USER_ITERATOR iterator;
+    startUserIteration(&iterator, room->id);
+    USER *user;
+    while ((user = nextUser(&iterator)) != NULL) {
+        PLAYER_SESSION *session = &getSeat(room, getSeatOfUser(user->id))->session;
+        CO_RESET(&session->coroutine);
+        session->answeredRound = -1;
+    }
 }
 
-static void handleQuestionRequest(int userId) {
-    MESSAGE questionResponse;
-    Question *question = NULL;
-    if (currentQuestion[userId] < getLoadedQuestionCount()) {
-        question = &getLoadedQuestions()[currentQuestion[userId]];
-        questionResponse = buildQuestion(question->question, question->answers, question->timeout);
-    } else {
-        questionResponse = buildQuestionEmpty();
-        finishedPlayerCount++;
-        checkAndHandleAllPlayersFinished();
+static void resumePlayerSession(int userId, int event, /* nullable */ MESSAGE *message) {
+    // A timer may fire just after its user has left
+    ROOM *room = getRoom(getRoomIdOfUser(userId));
+    if (room == NULL) {
+        return;
+    }
+    PLAYER_SESSION *session = &getSeat(room, getSeatOfUser(userId))->session;
+    session->event = event;
+    if (message != NULL) {
+        session->selected = message->body.questionAnswered.selected;
+    }
+    if (room->catalog != NULL) {
+        runPlayerSession(userId, room, session);
     }
+}
+
+//The way of one player through the questions, an event the session does not wait for is ignored
+static int runPlayerSession(int userId, ROOM *room, PLAYER_SESSION *session) {
+    CO_BEGIN(&session->coroutine);
+    for (session->question = 0; session->question < room->catalog->questionCount; session->question++) {
+        CO_AWAIT(&session->coroutine, session->event == SESSION_EVENT_QUESTION_REQUEST);
+        sendQuestion(userId, room, session->question);
+
+        // A timeout that fired while the previous answer was handled finds the timer running again
+        CO_AWAIT(&session->coroutine, session->event == SESSION_EVENT_QUESTION_ANSWERED
+                                      || (session->event == SESSION_EVENT_QUESTION_TIMEOUT
+                                          && getDurationMillisLeft(userId) == 0));
+        finishQuestion(userId, room, session);
+    }
+
+    CO_AWAIT(&session->coroutine, session->event == SESSION_EVENT_QUESTION_REQUEST);
+    // The empty question tells the player that there are no more, it has to arrive before the game over
+    sendQuestion(userId, room, session->question);
 
+    lockRoom(room->id);
+    room->finishedPlayerCount++;
+    unlockRoom(room->id);
+    checkAndHandleAllPlayersFinished(room);
+    CO_END(&session->coroutine);
+}
+
+static void sendQuestion(int userId, ROOM *room, int questionIndex) {
     // Project description tells to start the timer before we send the question
-    if (question != NULL) {
-        startTimer(userId, question->timeout, handleQuestionTimeout);
+    if (questionIndex < room->catalog->questionCount) {
+        startTimer(userId, room->catalog->questions[questionIndex].timeout, postQuestionTimeout);
     }
 
-    if (sendMessage(getUser(userId).clientSocket, &questionResponse) < 0) {
+    // The questions are encoded when the catalog is loaded, a request only picks the right frame
+    if (sendWireFrame(getUser(userId).clientSocket, getQuestionFrame(room->catalog, questionIndex)) < 0) {
         errorPrint("Unable to send question to %s (%d)!",
                    getUser(userId).username,
                    getUser(userId).id);
     }
 }
 
-static void handleQuestionAnswered(MESSAGE *message, int userId) {
-    if (currentQuestion[userId] >= getLoadedQuestionCount()) {
-        errorPrint("%s (%d) requested question out of bounds (#%d out of %d). !",
-                   getUser(userId).username,
-                   getUser(userId).id,
-                   currentQuestion[userId],
-                   getLoadedQuestionCount());
-        return;
+static void finishQuestion(int userId, ROOM *room, PLAYER_SESSION *session) {
+    Question *question = &room->catalog->questions[session->question];
+    int inTime = 0;
+    if (session->event == SESSION_EVENT_QUESTION_ANSWERED) {
+        long timeout = (long) question->timeout * 1000; // Convert to milliseconds
+        long durationMillis = getDurationMillisLeft(userId);
+        inTime = durationMillis <= timeout;
+
+        debugPrint("-- Answer -- timeout:\t%li", timeout);
+        debugPrint("-- Answer -- duration:\t%li", durationMillis);
+        debugPrint("-- Answer -- inTime:\t%s", inTime ? "yes" : "no");
+
+        // Calculate points if answer is correct
+        if (session->selected == question->correct && inTime) {
+            calcScoreForUserByID(timeout, durationMillis, userId);
+            notifyScoreAgent(room->id);
+        }
     }
 
-    Question question = getLoadedQuestions()[currentQuestion[userId]];
-    long timeout = (long) question.timeout * 1000; // Convert to milliseconds
-    long durationMillis = getDurationMillisLeft(userId);
-    int inTime = durationMillis <= timeout;
+    // Stop the timer
+    stopTimer(userId);
 
-    debugPrint("-- Answer -- timeout:\t%li", timeout);
-    debugPrint("-- Answer -- duration:\t%li", durationMillis);
-    debugPrint("-- Answer -- inTime:\t%s", inTime ? "yes" : "no");
+    // Send question result to client
+    MESSAGE questionResult = buildQuestionResult(question->correct, inTime);
+    if (sendMessage(getUser(userId).clientSocket, &questionResult) < 0) {
+        errorPrint("Unable to send question result to %s (%d)!",
+                   getUser(userId).username,
+                   getUser(userId).id);
+    }
+}
 
-    // Calculate points if answer is correct
-    if (message->body.questionAnswered.selected == question.correct && inTime) {
-        calcScoreForUserByID(timeout, durationMillis, userId);
-        notifyScoreAgent();
+//Sends the question of the round to all players at once, after the last question the empty one ends the game
+static void startRound(ROOM *room, int round) {
+    room->round = round;
+    room->answeredCount = 0;
+    if (room->roundResult != NULL) {
+        releaseWireFrame(room->roundResult);
+        room->roundResult = NULL;
     }
 
-    finalizeQuestionHandling(userId, inTime, &question);
-}
+    // Like for a single player, the timer starts before the question is sent
+    int questionCount = room->catalog->questionCount;
+    if (round < questionCount) {
+        Question *question = &room->catalog->questions[round];
+        MESSAGE questionResult = buildQuestionResult(question->correct, 1);
+        room->roundResult = encodeMessage(&questionResult);
+        startRoomTimer(room->id, question->timeout, postRoundTimeout);
+    }
 
-static void handleQuestionTimeout(int userId) {
-    // Load the question (again)
-    Question question = getLoadedQuestions()[currentQuestion[userId]];
+    ROSTER *roster = acquireRoster(room->id);
+    if (roster != NULL) {
+        broadcastWireFrame(roster, getQuestionFrame(room->catalog, round), "Unable to send question to %s (%d)!", -1);
+        releaseRoster(roster);
+    }
 
-    finalizeQuestionHandling(userId, 0, &question);
+    if (round >= questionCount) {
+        lockRoom(room->id);
+        room->finishedPlayerCount = room->userAmount;
+        unlockRoom(room->id);
+        checkAndHandleAllPlayersFinished(room);
+    }
 }
 
-static void finalizeQuestionHandling(int userId, int inTime, Question *question) {
-    // Stop the timer
-    stopTimer(userId);
+//Only the first answer of a player in a round counts, it is in time because the round is still running
+static void handleRoundAnswer(int userId, ROOM *room, MESSAGE *message) {
+    PLAYER_SESSION *session = &getSeat(room, getSeatOfUser(userId))->session;
+    if (room->round >= room->catalog->questionCount || session->answeredRound == room->round) {
+        return;
+    }
+    session->answeredRound = room->round;
+    room->answeredCount++;
 
-    // Send question result to client
-    MESSAGE questionResult = buildQuestionResult(question->correct, inTime);
-    if (sendMessage(getUser(userId).clientSocket, &questionResult) < 0) {
+    Question *question = &room->catalog->questions[room->round];
+    if (message->body.questionAnswered.selected == question->correct) {
+        calcScoreForUserByID((long) question->timeout * 1000, getRoomMillisLeft(room->id), userId);
+        notifyScoreAgent(room->id);
+    }
+
+    if (room->roundResult == NULL || sendWireFrame(getUser(userId).clientSocket, room->roundResult) < 0) {
         errorPrint("Unable to send question result to %s (%d)!",
                    getUser(userId).username,
                    getUser(userId).id);
     }
 
-    // Go to next question
-    currentQuestion[userId]++;
+    if (room->answeredCount >= getUserAmount(room->id)) {
+        endRound(room);
+    }
+}
+
+static void handleRoundTimeout(ROOM *room) {
+    // A timeout that was posted before the round ended early finds the timer of the next round running
+    if (room == NULL || room->gameState != GAME_STATE_GAME_RUNNING || room->catalog == NULL
+        || room->round >= room->catalog->questionCount || getRoomMillisLeft(room->id) != 0) {
+        return;
+    }
+    endRound(room);
+}
+
+//A player that has left does not hold up the round anymore
+static void leaveRound(ROOM *room, int answered) {
+    if (room->gameState != GAME_STATE_GAME_RUNNING || room->round >= room->catalog->questionCount) {
+        return;
+    }
+    if (answered) {
+        room->answeredCount--;
+    } else if (room->answeredCount >= getUserAmount(room->id)) {
+        endRound(room);
+    }
+}
+
+//The players without an answer get the result of a timeout, then the next round starts
+static void endRound(ROOM *room) {
+    stopRoomTimer(room->id);
+
+    MESSAGE questionResult = buildQuestionResult(room->catalog->questions[room->round].correct, 0);
+    WIRE_FRAME *timeoutResult = encodeMessage(&questionResult);
+    lockRoom(room->id);
+    USER_ITERATOR iterator;
+    startUserIteration(&iterator, room->id);
+    USER *user;
+    while ((user = nextUser(&iterator)) != NULL) {
+        PLAYER_SESSION *session = &getSeat(room, getSeatOfUser(user->id))->session;
+        if (session->answeredRound == room->round) {
+            continue;
+        }
+        session->answeredRound = room->round;
+        if (timeoutResult == NULL || sendWireFrame(user->clientSocket, timeoutResult) < 0) {
+            errorPrint("Unable to send question result to %s (%d)!", user->username, user->id);
+        }
+    }
+    unlockRoom(room->id);
+    if (timeoutResult != NULL) {
+        releaseWireFrame(timeoutResult);
+    }
+
+    startRound(room, room->round + 1);
 }
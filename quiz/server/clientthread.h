@@ -4,20 +4,16 @@
  *
  * Server
  *
- * clientthread.h: Header für den Client-Thread
+ * clientthread.h: Header für die Client-Behandlung
  */
 #ifndef CLIENTTHREAD_H
 #define CLIENTTHREAD_H
 
-enum {
-    GAME_STATE_PREPARATION = 1,
-    GAME_STATE_GAME_RUNNING = 2,
-    GAME_STATE_FINISHED = 3,
-    GAME_STATE_ABORTED = 4
-};
+#include "receivebuffer.h"
 
-int initializeClientThreadModule();
+int initializeClientThreadModule(int reactorBackend, int reactorCount, int actorCount, int slowConsumerPolicy,
+                                 int synchronized);
 
-int startClientThread(int userId);
+int startClientHandling(int userId, /* nullable */ RECEIVE_BUFFER *received);
 
 #endif
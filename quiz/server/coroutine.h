@@ -0,0 +1,44 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * coroutine.h: Stacklose Koroutinen
+ *
+ * Eine Koroutine ist eine Funktion, die zwischen CO_BEGIN und CO_END
+ * sequentiell geschrieben wird und an jedem CO_AWAIT zurückkehrt, solange die
+ * Bedingung nicht erfüllt ist. Beim nächsten Aufruf läuft sie hinter diesem
+ * CO_AWAIT weiter (switch auf die gemerkte Zeilennummer). Sie hat keinen
+ * eigenen Stack, lokale Variablen überleben ein CO_AWAIT daher nicht und
+ * gehören in die Struktur, die die Koroutine mit sich führt.
+ * Innerhalb einer Koroutine darf kein weiteres switch ein CO_AWAIT enthalten.
+ */
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+enum {
+    COROUTINE_SUSPENDED = 0,
+    COROUTINE_FINISHED = 1
+};
+
+typedef struct {
+    int resumeLine; // 0 before the first run, -1 when finished
+} COROUTINE;
+
+#define CO_RESET(co) ((co)->resumeLine = 0)
+
+#define CO_BEGIN(co) switch ((co)->resumeLine) { case 0:
+
+#define CO_AWAIT(co, condition)                 \
+    do {                                        \
+        (co)->resumeLine = __LINE__;            \
+        case __LINE__:                          \
+        if (!(condition)) {                     \
+            return COROUTINE_SUSPENDED;         \
+        }                                       \
+    } while (0)
+
+#define CO_END(co) } (co)->resumeLine = -1; return COROUTINE_FINISHED
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * hashindex.c: Implementierung der Hash-Indizes mit offener Adressierung
+ *
+ * Kollisionen werden linear sondiert. Beim Entfernen rücken die folgenden
+ * Einträge nach (backward shift), so braucht der Index keine Grabsteine und
+ * eine Suche endet immer am ersten leeren Platz. Gesperrt wird vom Aufrufer.
+ */
+#include <stdlib.h>
+#include "hashindex.h"
+#include "../common/util.h"
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+int initHashIndex(HASH_INDEX *index, int capacity) {
+    // At most half full, so probe sequences stay short
+    unsigned int size = 2;
+    while (size < 2U * (unsigned int) capacity) {
+        size *= 2;
+    }
+
+    index->values = malloc(size * sizeof(int));
+    index->hashes = malloc(size * sizeof(unsigned int));
+    if (index->values == NULL || index->hashes == NULL) {
+        errorPrint("Could not allocate hash index!");
+        free(index->values);
+        free(index->hashes);
+        return -1;
+    }
+    index->mask = size - 1;
+    clearHashIndex(index);
+    return 0;
+}
+
+void clearHashIndex(HASH_INDEX *index) {
+    for (unsigned int i = 0; i <= index->mask; i++) {
+        index->values[i] = -1;
+    }
+}
+
+//return the value that matches the key or -1
+int findHashIndex(HASH_INDEX *index, unsigned int hash, int (*matches)(int value, const void *key, void *context),
+                  const void *key, void *context) {
+    for (unsigned int i = hash & index->mask; index->values[i] != -1; i = (i + 1) & index->mask) {
+        if (index->hashes[i] == hash && matches(index->values[i], key, context)) {
+            return index->values[i];
+        }
+    }
+    return -1;
+}
+
+//The caller makes sure that the index never gets full
+void insertHashIndex(HASH_INDEX *index, unsigned int hash, int value) {
+    unsigned int i = hash & index->mask;
+    while (index->values[i] != -1) {
+        i = (i + 1) & index->mask;
+    }
+    index->values[i] = value;
+    index->hashes[i] = hash;
+}
+
+void removeHashIndex(HASH_INDEX *index, unsigned int hash, int value) {
+    unsigned int i = hash & index->mask;
+    while (index->values[i] != -1 && !(index->values[i] == value && index->hashes[i] == hash)) {
+        i = (i + 1) & index->mask;
+    }
+    if (index->values[i] == -1) {
+        return;
+    }
+
+    // Move every following entry back that would not be found anymore behind the gap
+    unsigned int gap = i;
+    for (unsigned int next = (i + 1) & index->mask; index->values[next] != -1; next = (next + 1) & index->mask) {
+        unsigned int home = index->hashes[next] & index->mask;
+        if (((next - home) & index->mask) >= ((next - gap) & index->mask)) {
+            index->values[gap] = index->values[next];
+            index->hashes[gap] = index->hashes[next];
+            gap = next;
+        }
+    }
+    index->values[gap] = -1;
+}
+
+//FNV-1a
+unsigned int hashString(const char *key) {
+    unsigned int hash = 2166136261U;
+    for (; *key != '\0'; key++) {
+        hash = (hash ^ (unsigned char) *key) * 16777619U;
+    }
+    return hash;
+}
+
+//Spreads consecutive descriptors over the table (murmur3 finalizer)
+unsigned int hashInt(int key) {
+    unsigned int hash = (unsigned int) key;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
+}
@@ -0,0 +1,38 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * hashindex.h: Header für Hash-Indizes mit offener Adressierung
+ *
+ * Ein Index speichert nur Werte (z.B. Plätze oder IDs), ihre Schlüssel kennt
+ * der Aufrufer. Er übergibt den Hash des Schlüssels und zum Suchen eine
+ * Funktion, die prüft, ob ein Wert zum Schlüssel gehört. Die Tabelle ist
+ * mindestens doppelt so groß wie die Zahl der Werte, die hineinpassen müssen.
+ */
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+typedef struct {
+    int *values; // -1 marks an empty slot
+    unsigned int *hashes;
+    unsigned int mask;
+} HASH_INDEX;
+
+int initHashIndex(HASH_INDEX *index, int capacity);
+
+void clearHashIndex(HASH_INDEX *index);
+
+int findHashIndex(HASH_INDEX *index, unsigned int hash, int (*matches)(int value, const void *key, void *context),
+                  const void *key, void *context);
+
+void insertHashIndex(HASH_INDEX *index, unsigned int hash, int value);
+
+void removeHashIndex(HASH_INDEX *index, unsigned int hash, int value);
+
+unsigned int hashString(const char *key);
+
+unsigned int hashInt(int key);
+
+#endif
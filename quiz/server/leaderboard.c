@@ -0,0 +1,157 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * leaderboard.c: Implementierung der Rangliste eines Raumes
+ *
+ * Der Treap wird nur über split und merge verändert. Die Prioritäten sind
+ * zufällig, dadurch ist der Baum im Mittel O(log n) tief. Die Rangliste wird
+ * mit dem Mutex ihres Raumes geschützt.
+ */
+#include <stddef.h>
+#include "leaderboard.h"
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static int isBefore(unsigned int score, int seat, const LEADERBOARD_NODE *node);
+
+static int getSize(const LEADERBOARD_NODE *node);
+
+static void updateSize(LEADERBOARD_NODE *node);
+
+static void split(LEADERBOARD_NODE *node, unsigned int score, int seat, LEADERBOARD_NODE **before,
+                  LEADERBOARD_NODE **after);
+
+static LEADERBOARD_NODE *merge(LEADERBOARD_NODE *before, LEADERBOARD_NODE *after);
+
+static int visitTop(const LEADERBOARD_NODE *node, int count, void (*visit)(const LEADERBOARD_NODE *node, void *context),
+                    void *context, int visited);
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+void initLeaderboard(LEADERBOARD *board, uint32_t seed) {
+    board->root = NULL;
+    board->seed = seed != 0 ? seed : 1;
+}
+
+void insertLeaderboardNode(LEADERBOARD *board, LEADERBOARD_NODE *node, unsigned int score, int seat) {
+    // xorshift32 is good enough to keep the treap balanced
+    board->seed ^= board->seed << 13;
+    board->seed ^= board->seed >> 17;
+    board->seed ^= board->seed << 5;
+
+    node->left = NULL;
+    node->right = NULL;
+    node->priority = board->seed;
+    node->size = 1;
+    node->score = score;
+    node->seat = seat;
+
+    LEADERBOARD_NODE *before;
+    LEADERBOARD_NODE *after;
+    split(board->root, score, seat, &before, &after);
+    board->root = merge(merge(before, node), after);
+}
+
+void removeLeaderboardNode(LEADERBOARD *board, LEADERBOARD_NODE *node) {
+    // Everything before the node, the node itself and everything after it
+    LEADERBOARD_NODE *before;
+    LEADERBOARD_NODE *rest;
+    LEADERBOARD_NODE *single;
+    LEADERBOARD_NODE *after;
+    split(board->root, node->score, node->seat, &before, &rest);
+    split(rest, node->score, node->seat + 1, &single, &after);
+    board->root = merge(before, after);
+}
+
+void updateLeaderboardScore(LEADERBOARD *board, LEADERBOARD_NODE *node, unsigned int score) {
+    int seat = node->seat;
+    removeLeaderboardNode(board, node);
+    insertLeaderboardNode(board, node, score, seat);
+}
+
+//return 1 + the number of players with more points, so players with the same points share their rank
+int getLeaderboardRank(LEADERBOARD *board, unsigned int score) {
+    int better = 0;
+    const LEADERBOARD_NODE *node = board->root;
+    while (node != NULL) {
+        if (node->score > score) {
+            better += getSize(node->left) + 1;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return better + 1;
+}
+
+//Visits the best count players in order, return their number
+int visitLeaderboardTop(LEADERBOARD *board, int count, void (*visit)(const LEADERBOARD_NODE *node, void *context),
+                        void *context) {
+    return visitTop(board->root, count, visit, context, 0);
+}
+
+//return 1 if a node with score and seat belongs before the node
+static int isBefore(unsigned int score, int seat, const LEADERBOARD_NODE *node) {
+    return score > node->score || (score == node->score && seat < node->seat);
+}
+
+static int getSize(const LEADERBOARD_NODE *node) {
+    return node != NULL ? node->size : 0;
+}
+
+static void updateSize(LEADERBOARD_NODE *node) {
+    node->size = getSize(node->left) + getSize(node->right) + 1;
+}
+
+//Splits into the nodes before (score, seat) and the ones from there on
+static void split(LEADERBOARD_NODE *node, unsigned int score, int seat, LEADERBOARD_NODE **before,
+                  LEADERBOARD_NODE **after) {
+    if (node == NULL) {
+        *before = NULL;
+        *after = NULL;
+    } else if (isBefore(node->score, node->seat, &(LEADERBOARD_NODE) {.score = score, .seat = seat})) {
+        split(node->right, score, seat, &node->right, after);
+        updateSize(node);
+        *before = node;
+    } else {
+        split(node->left, score, seat, before, &node->left);
+        updateSize(node);
+        *after = node;
+    }
+}
+
+//All nodes of before have to be before all nodes of after
+static LEADERBOARD_NODE *merge(LEADERBOARD_NODE *before, LEADERBOARD_NODE *after) {
+    if (before == NULL) {
+        return after;
+    }
+    if (after == NULL) {
+        return before;
+    }
+    if (before->priority > after->priority) {
+        before->right = merge(before->right, after);
+        updateSize(before);
+        return before;
+    }
+    after->left = merge(before, after->left);
+    updateSize(after);
+    return after;
+}
+
+static int visitTop(const LEADERBOARD_NODE *node, int count, void (*visit)(const LEADERBOARD_NODE *node, void *context),
+                    void *context, int visited) {
+    if (node == NULL || visited >= count) {
+        return visited;
+    }
+    visited = visitTop(node->left, count, visit, context, visited);
+    if (visited < count) {
+        visit(node, context);
+        visited++;
+    }
+    return visitTop(node->right, count, visit, context, visited);
+}
@@ -0,0 +1,47 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * leaderboard.h: Header für die Rangliste eines Raumes
+ *
+ * Die Rangliste ist ein Treap, dessen Knoten ihre Teilbaumgröße kennen.
+ * Sie ist nach Punkten absteigend und bei gleichen Punkten nach Platz sortiert.
+ * Einfügen, Entfernen, Punkte ändern und der Rang eines Spielers kosten
+ * O(log n), die besten K Spieler O(log n + K). Die Knoten gehören dem
+ * Aufrufer (ein Knoten pro Platz), die Rangliste legt selbst keinen Speicher an.
+ */
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <stdint.h>
+
+typedef struct leaderboard_node {
+    struct leaderboard_node *left;
+    struct leaderboard_node *right;
+    uint32_t priority;
+    int size; // Nodes in this subtree
+    unsigned int score;
+    int seat;
+} LEADERBOARD_NODE;
+
+typedef struct {
+    LEADERBOARD_NODE *root;
+    uint32_t seed; // For the node priorities
+} LEADERBOARD;
+
+void initLeaderboard(LEADERBOARD *board, uint32_t seed);
+
+void insertLeaderboardNode(LEADERBOARD *board, LEADERBOARD_NODE *node, unsigned int score, int seat);
+
+void removeLeaderboardNode(LEADERBOARD *board, LEADERBOARD_NODE *node);
+
+void updateLeaderboardScore(LEADERBOARD *board, LEADERBOARD_NODE *node, unsigned int score);
+
+int getLeaderboardRank(LEADERBOARD *board, unsigned int score);
+
+int visitLeaderboardTop(LEADERBOARD *board, int count, void (*visit)(const LEADERBOARD_NODE *node, void *context),
+                        void *context);
+
+#endif
@@ -6,9 +6,27 @@
  *
  * login.c: Implementierung des Logins
  *
- * Dieses Modul beinhaltet die Funktionalität des Login-Threads. Das heißt,
- * hier wird die Schleife zum Entgegennehmen von Verbindungen mittels accept(2)
- * implementiert.
+ * Dieses Modul beinhaltet die Funktionalität des Logins. Pro Reactor wird ein
+ * eigener Listen-Socket mit SO_REUSEPORT auf dem Port geöffnet, sodass der Kernel
+ * die Verbindungen auf die Reactoren verteilt. Die Reactoren nehmen die
+ * Verbindungen an und übergeben sie an handleNewConnection().
+ * Der Login-Request wird nicht blockierend gelesen: Jede Verbindung durchläuft
+ * als Handshake die Zustände "angenommen", "wartet auf Login" und "angemeldet".
+ * Der Reactor meldet, wenn Daten bereitstehen, und es wird nur gelesen, was
+ * vorhanden ist. So können beliebig viele Logins parallel laufen. Handshakes,
+ * die ihre Frist überschreiten, werden von einem Timer geschlossen.
+ * Welche Verbindung sofort zum Login darf, warten muss oder abgewiesen wird,
+ * entscheidet das Modul admission. Abgewiesene Verbindungen erhalten eine
+ * Fehlermeldung und werden geschlossen.
+ * Optional lauscht der Server zusätzlich auf einem Unix-Socket für lokale Clients.
+ * Diese können vor dem Login einen Shared-Memory-Kanal anmelden (siehe
+ * shmtransport.h), über den dann auch der Login-Request kommt.
+ * Bei einem Update übergibt der Login die Listen-Sockets und alle Verbindungen,
+ * die noch in der Vorbereitung eines Raumes sind, an den Nachfolger (siehe
+ * upgrade.c). Der Nachfolger übernimmt sie mit den adopt-Funktionen.
+ * Mit Matchmaking (siehe matchmaker.h) kommt ein angemeldeter Client erst in
+ * die Warteschlange. Jede Gruppe bekommt einen neuen Raum, in dem das Spiel
+ * mit dem Katalog des Matchmakings gleich startet.
  * Benutzen Sie für die Verwaltung der bereits angemeldeten Clients und zum
  * Eintragen neuer Clients die von Ihnen entwickelten Funktionen aus dem Modul
  * user.
@@ -19,6 +37,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include "vardefine.h"
 #include "user.h"
@@ -26,65 +45,401 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
 #include "clientthread.h"
-#include "threadholder.h"
+#include "reactor.h"
 #include "score.h"
+#include "mutexhelper.h"
+#include "admission.h"
+#include "shmtransport.h"
+#include "upgrade.h"
+#include "threadholder.h"
+#include "room.h"
+#include "hashindex.h"
+#include "matchmaker.h"
+#include "roomactor.h"
+#include "catalog.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+#define HANDSHAKE_TIMEOUT_SECONDS 10
+#define HANDSHAKE_REAP_INTERVAL_SECONDS 1
+
+enum {
+    HANDSHAKE_STATE_FREE = 0,
+    HANDSHAKE_STATE_ACCEPTED = 1,
+    HANDSHAKE_STATE_AWAITING_LOGIN = 2,
+    HANDSHAKE_STATE_AUTHENTICATED = 3
+};
+
+typedef struct {
+    int state;
+    int clientSocket;
+    int local;
+    SHM_CHANNEL *channel;
+    struct timespec deadline;
+    size_t received;
+    char buffer[sizeof(MESSAGE)];
+} HANDSHAKE;
 
 //------------------------------------------------------------------------------
 // Method pre-declaration
 //------------------------------------------------------------------------------
-static int startLoginListener(int *port);
+static int createListenSocket(int port, int backlog);
+
+static int createLocalListenSocket(char *path, int backlog);
+
+static int startHandshakeReaper();
+
+static void handleNewConnection(int client_sock);
+
+static HANDSHAKE *startHandshake(int client_sock);
+
+static void shedConnection(int client_sock, char *reason);
+
+static int getUsedSlotCount();
+
+static int getHandshakeCount();
+
+static int handleHandshakeData(int client_sock);
+
+static ssize_t receiveHandshakeData(HANDSHAKE *handshake, size_t missing);
+
+static void closeClientSocket(int client_sock);
+
+static void handleLoginRequest(int client_sock, MESSAGE *message);
+
+static int finishLogin(int clientID, int client_sock, MESSAGE *message);
+
+static void startMatch(MATCH_TICKET *group, int playerCount);
+
+static void handOffQueuedLogin(int client_sock, MESSAGE *message);
+
+static HANDSHAKE *findHandshake(int client_sock);
+
+static void closeHandshake(HANDSHAKE *handshake);
+
+static int isSocketOfHandshake(int handshakeIndex, const void *client_sock, void *context);
+
+static void forgetHandshakeSocket(HANDSHAKE *handshake);
+
+static void reapHandshakes(union sigval value);
+
+static void handOffHandshake(HANDSHAKE *handshake);
+
+static int handOffLobbyUser(int userId);
+
+static void handOffReleasedUser(int client_sock, int userId, RECEIVE_BUFFER *received, SEND_QUEUE *unsent);
+
+static void checkRetirement();
 
 //------------------------------------------------------------------------------
 // Fields
 //------------------------------------------------------------------------------
-static pthread_t loginThreadId = 0;
+// One handshake per admission slot, so an admitted login always finds one
+static HANDSHAKE *handshakes = NULL;
+static int handshakeCapacity = 0;
+static pthread_mutex_t handshakeMutex;
+
+// The handshakes waiting for their login request by socket, every received chunk looks its handshake up
+static HASH_INDEX handshakeSocketIndex;
 
-static int loginIsEnable = -1;
+static timer_t handshakeReaperTimer;
+
+static int *listenSockets = NULL;
+static int listenSocketCount = 0;
+
+static int localListenSocket = -1;
+static char *localListenPath = NULL;
+
+// Set once the listen sockets have been handed to a successor
+static int retired = 0;
+static int handOffFinished = 0;
+
+// The catalog every match plays
+static char matchCatalogName[CATALOG_FILENAME_SIZE];
 
 //------------------------------------------------------------------------------
 // Implementations
 //------------------------------------------------------------------------------
-//Main - start function for login thread
-int startLoginThread(int *port) {
-    int result = pthread_create(&loginThreadId, NULL, (void *) &startLoginListener, (void *) port);
-    if (result != 0) {
-        errorPrint("Can't create Login thread");
+//Has to be called before startLogin() and before connections are taken over from a predecessor
+int initLogin(int waitingCapacity, int connectionLimit) {
+    if (mutexInit(&handshakeMutex, NULL) < 0) {
+        errorPrint("Could not init handshake MUTEX!");
+        return -1;
+    }
+    handshakeCapacity = getMaxRoomCount() * getRoomCapacity();
+    handshakes = calloc((size_t) handshakeCapacity, sizeof(HANDSHAKE));
+    if (handshakes == NULL) {
+        errorPrint("Could not allocate the handshake table!");
+        return -1;
+    }
+    if (initHashIndex(&handshakeSocketIndex, handshakeCapacity) < 0) {
         return -1;
     }
+    if (startHandshakeReaper() < 0) {
+        return -1;
+    }
+    // Every seat of every room is a slot
+    if (initAdmission(waitingCapacity, connectionLimit, handshakeCapacity) < 0) {
+        return -1;
+    }
+    return 0;
+}
 
-    infoPrint("Login thread created successfully");
-    registerThread(loginThreadId);
+//return -1 if the catalog does not exist, the catalogs have to be fetched already
+int startMatchmaking(char *catalogName, int waitSeconds) {
+    int catalogIndex = 0;
+    while (catalogIndex < getCatalogCount() && strcmp(getCatalogNameByIndex(catalogIndex), catalogName) != 0) {
+        catalogIndex++;
+    }
+    if (catalogIndex == getCatalogCount() || strlen(catalogName) >= CATALOG_FILENAME_SIZE) {
+        errorPrint("Catalog %s for the matchmaking does not exist!", catalogName);
+        return -1;
+    }
+    strcpy(matchCatalogName, catalogName);
+
+    return startMatchmaker(getRoomCapacity(), waitSeconds, startMatch) < 0 ? -2 : 0;
+}
+//Main - start function for the login, the reactors have to be started already
+int startLogin(int port, /* nullable */ char *localPath, int backlog) {
+    infoPrint("Starting login listeners...");
+
+    // Every reactor gets its own listen socket on the same port, taken over ones are spread over the reactors
+    int inheritedCount = listenSocketCount;
+    int socketCount = getReactorCount() > inheritedCount ? getReactorCount() : inheritedCount;
+    int *sockets = realloc(listenSockets, socketCount * sizeof(int));
+    if (sockets == NULL) {
+        errorPrint("Could not allocate listen sockets");
+        return -1;
+    }
+    listenSockets = sockets;
+
+    for (int i = inheritedCount; i < socketCount; i++) {
+        listenSockets[i] = createListenSocket(port, backlog);
+        if (listenSockets[i] < 0) {
+            listenSocketCount = i;
+            return -2;
+        }
+        listenSocketCount = i + 1;
+    }
+    for (int i = 0; i < listenSocketCount; i++) {
+        if (reactorAddListener(i % getReactorCount(), listenSockets[i], handleNewConnection) < 0) {
+            errorPrint("Could not add listen socket to reactor %d", i % getReactorCount());
+            return -3;
+        }
+    }
+
+    infoPrint("Bind %d sockets to local IP on Port: %d (%d taken over), and listening...", listenSocketCount, port,
+              inheritedCount);
+
+    // Local clients are rare, so the first reactor accepts all of them
+    if (localListenSocket < 0 && localPath != NULL) {
+        localListenSocket = createLocalListenSocket(localPath, backlog);
+        if (localListenSocket < 0) {
+            return -4;
+        }
+        localListenPath = localPath;
+    }
+    if (localListenSocket >= 0) {
+        if (reactorAddListener(0, localListenSocket, handleNewConnection) < 0) {
+            errorPrint("Could not add local listen socket to reactor 0");
+            return -5;
+        }
+        infoPrint("Bind local socket to %s, and listening...", localListenPath);
+    }
     return 0;
 }
 
-void enableLogin() {
-    loginIsEnable = -1;
+//Keeps a listen socket of the predecessor, the local one comes with its path
+int inheritListenSocket(int listenSocket, /* nullable */ char *localPath) {
+    if (localPath != NULL) {
+        localListenSocket = listenSocket;
+        localListenPath = localPath;
+        return 0;
+    }
+
+    int *sockets = realloc(listenSockets, (listenSocketCount + 1) * sizeof(int));
+    if (sockets == NULL) {
+        errorPrint("Could not allocate listen sockets");
+        return -1;
+    }
+    listenSockets = sockets;
+    listenSockets[listenSocketCount++] = listenSocket;
+    return 0;
 }
 
-void disableLogin() {
-    loginIsEnable = 1;
+void closeLoginSockets() {
+    for (int i = 0; i < listenSocketCount; i++) {
+        close(listenSockets[i]);
+    }
+    listenSocketCount = 0;
+
+    if (localListenSocket >= 0) {
+        close(localListenSocket);
+        // After an upgrade the socket file belongs to the successor
+        if (localListenPath != NULL) {
+            unlink(localListenPath);
+        }
+        localListenSocket = -1;
+    }
 }
 
-//return -1 on error
-static int startLoginListener(int *port) { // TODO FEEDBACK: Should return void* and get void* pointer for port
-    // Initialise UserData
-    initUserData();
+//Hands the listen sockets and all connections that do not take part in a running game to the successor
+void retireLogin() {
+    mutexLock(&handshakeMutex);
+    retired = 1;
 
-    infoPrint("Starting login listener...");
+    // The kernel keeps queueing new connections on the sockets, the successor accepts them from now on.
+    // Our descriptors stay open until the exit, a reactor may still be accepting on them.
+    for (int i = 0; i < listenSocketCount; i++) {
+        reactorRemoveListener(listenSockets[i]);
+        handOffSocket(HANDOFF_LISTENER, listenSockets[i], -1, -1, NULL, NULL, 0, NULL, 0);
+    }
+    if (localListenSocket >= 0) {
+        reactorRemoveListener(localListenSocket);
+        handOffSocket(HANDOFF_LOCAL_LISTENER, localListenSocket, -1, -1, NULL, localListenPath,
+                      strlen(localListenPath) + 1, NULL, 0);
+        localListenPath = NULL;
+    }
 
-    // Client descriptor
     int client_sock;
+    while ((client_sock = takeWaitingConnection(0)) >= 0) {
+        handOffSocket(HANDOFF_WAITING, client_sock, -1, -1, NULL, NULL, 0, NULL, 0);
+        close(client_sock);
+    }
+    for (int i = 0; i < handshakeCapacity; i++) {
+        if (handshakes[i].state == HANDSHAKE_STATE_AWAITING_LOGIN) {
+            handOffHandshake(&handshakes[i]);
+        }
+    }
+    mutexUnlock(&handshakeMutex);
+
+    // Queued logins have no room yet, the successor queues them again
+    retireMatchmaker(handOffQueuedLogin);
+
+    // Players of a running game stay until it is over, the rooms in preparation move to the successor.
+    // The reactors release the users in their own time, so this is done without the handshake mutex.
+    int *userIds = malloc((size_t) getRoomCapacity() * sizeof(int));
+    for (int roomId = 0; userIds != NULL && roomId < getMaxRoomCount(); roomId++) {
+        int userCount = collectRoomUserIds(roomId, GAME_STATE_PREPARATION, userIds);
+        for (int i = 0; i < userCount; i++) {
+            handOffLobbyUser(userIds[i]);
+        }
+    }
+    if (userIds == NULL) {
+        errorPrint("Could not allocate the ids of the lobby users, they stay until they leave");
+    }
+    free(userIds);
+
+    mutexLock(&handshakeMutex);
+    checkRetirement();
+    mutexUnlock(&handshakeMutex);
+}
 
+int isLoginRetired() {
+    return retired;
+}
+
+//A retired server exits once its last game is over
+void checkLoginRetirement() {
+    mutexLock(&handshakeMutex);
+    checkRetirement();
+    mutexUnlock(&handshakeMutex);
+}
+
+//Connections taken over from the predecessor go through the admission like new ones
+void adoptWaitingConnection(int client_sock) {
+    handleNewConnection(client_sock);
+}
+
+//A login taken over from the predecessor continues with what was received so far
+void adoptHandshake(int client_sock, const char *received, size_t length) {
+    mutexLock(&handshakeMutex);
+    if (length > sizeof(handshakes[0].buffer)) {
+        errorPrint("Login taken over on socket %d is too long, closing connection", client_sock);
+        close(client_sock);
+    } else {
+        HANDSHAKE *handshake = startHandshake(client_sock);
+        if (handshake != NULL) {
+            memcpy(handshake->buffer, received, length);
+            handshake->received = length;
+        }
+    }
+    mutexUnlock(&handshakeMutex);
+
+    // A login that was queued for matchmaking is complete already, no more data will come for it
+    MESSAGE message;
+    if (unpackMessage(received, length, &message) > 0) {
+        handleHandshakeData(client_sock);
+    }
+}
+
+//A lobby user taken over from the predecessor keeps its room and seat if possible, what it did not get yet is sent first
+int adoptLobbyUser(int client_sock, int roomId, int seat, char *username, RECEIVE_BUFFER *received, const char *unsent,
+                   size_t unsentLength) {
+    // The socket is still non-blocking if the predecessor used epoll
+    int socketFlags = fcntl(client_sock, F_GETFL);
+    if (unsentLength > 0 && (socketFlags < 0 || fcntl(client_sock, F_SETFL, socketFlags & ~O_NONBLOCK) < 0
+                             || send(client_sock, unsent, unsentLength, MSG_NOSIGNAL) != (ssize_t) unsentLength)) {
+        errnoPrint("Could not send the pending messages of a user taken over");
+        close(client_sock);
+        return -1;
+    }
+
+    int clientID = restoreUser(roomId, seat, username, client_sock);
+    if (clientID < 0) {
+        clientID = addUser(username, client_sock);
+    }
+    if (clientID < 0) {
+        errorPrint("Error: User %s taken over could not be added to user data", username);
+        close(client_sock);
+        return -2;
+    }
+    if (startClientHandling(clientID, received) < 0) {
+        removeUser(clientID);
+        close(client_sock);
+        return -3;
+    }
+    infoPrint("Took over user %s (%d, formerly seat %d in room %d) from the predecessor", username, clientID, seat,
+              roomId);
+    notifyScoreAgent(getRoomIdOfUser(clientID));
+    return 0;
+}
+
+//Lets waiting connections log in as long as there are free slots
+void admitWaitingConnections() {
+    mutexLock(&handshakeMutex);
+    int client_sock;
+    while ((client_sock = takeWaitingConnection(getUsedSlotCount())) >= 0) {
+        infoPrint("Connection on socket %d gets a free slot", client_sock);
+        startHandshake(client_sock);
+    }
+    checkRetirement();
+    mutexUnlock(&handshakeMutex);
+}
+
+//return -1 on error
+static int createListenSocket(int port, int backlog) {
     // Socket create type AF_INET IPv4, TCP
-    serverSocketFileDescriptor = socket(AF_INET, SOCK_STREAM, 0);
-    // Allow the socket to be reused immediately
-    int sockOptOn = 1;
-    setsockopt(serverSocketFileDescriptor, SOL_SOCKET, SO_REUSEADDR, &sockOptOn, sizeof(sockOptOn));
+    // The reactor accepts until EAGAIN, so the socket must not block
+    int listenSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     // Print error
-    if (serverSocketFileDescriptor < 0) {
+    if (listenSocket < 0) {
         errorPrint("Could not create listen socket for server");
-        exit(1);
+        return -1;
+    }
+
+    // Allow the socket to be reused immediately and by the other reactors
+    int sockOptOn = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &sockOptOn, sizeof(sockOptOn));
+    if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &sockOptOn, sizeof(sockOptOn)) < 0) {
+        errnoPrint("Could not enable SO_REUSEPORT on listen socket");
+        close(listenSocket);
+        return -1;
     }
 
     //specify IP-address and listening port
@@ -92,85 +447,517 @@ static int startLoginListener(int *port) { // TODO FEEDBACK: Should return void*
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(*port);
+    addr.sin_port = htons(port);
 
     //Socket bind to local IP and port
-    if (bind(serverSocketFileDescriptor, (const struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    if (bind(listenSocket, (const struct sockaddr *) &addr, sizeof(addr)) < 0) {
         errorPrint("Could not bind socket to address");
-        exit(1);
+        close(listenSocket);
+        return -1;
     }
 
     // Listen to connections
-    if (listen(serverSocketFileDescriptor, MAXCONNECTIONS) < 0) {
+    if (listen(listenSocket, backlog) < 0) {
         errorPrint("Could not listen for client connections");
-        exit(1);
+        close(listenSocket);
+        return -1;
     }
-    infoPrint("Bind socket to local IP on Port: %d, and listening...", *port);
+    return listenSocket;
+}
 
-    while (1) {
-        //waits for client connection
-        //accept() - blockiert und wartet bis eine Verbindung vom Client aufgebaut wird
-        //client_sock beinhaltet den Socket-Deskriptor des Clients
-        client_sock = accept(serverSocketFileDescriptor, NULL, NULL);
-        // In case the socket was closed, do not print an error
-        if (errno == EBADF) {
-            return -1;
+//return -1 on error
+static int createLocalListenSocket(char *path, int backlog) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errorPrint("Local socket path is too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenSocket < 0) {
+        errnoPrint("Could not create local listen socket");
+        return -1;
+    }
+
+    // A socket file left over by a crashed server would make bind() fail
+    unlink(path);
+    if (bind(listenSocket, (const struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        errnoPrint("Could not bind local socket");
+        close(listenSocket);
+        return -1;
+    }
+    if (listen(listenSocket, backlog) < 0) {
+        errnoPrint("Could not listen for local client connections");
+        close(listenSocket);
+        unlink(path);
+        return -1;
+    }
+    return listenSocket;
+}
+
+static int startHandshakeReaper() {
+    // The reaper runs in its own thread, so an idle client never blocks the reactors
+    struct sigevent event = {0};
+    event.sigev_notify = SIGEV_THREAD;
+    event.sigev_notify_function = reapHandshakes;
+    if (timer_create(CLOCK_MONOTONIC, &event, &handshakeReaperTimer) < 0) {
+        errnoPrint("Unable to create handshake reaper timer");
+        return -1;
+    }
+
+    struct itimerspec interval = {0};
+    interval.it_value.tv_sec = HANDSHAKE_REAP_INTERVAL_SECONDS;
+    interval.it_interval.tv_sec = HANDSHAKE_REAP_INTERVAL_SECONDS;
+    if (timer_settime(handshakeReaperTimer, 0, &interval, NULL) < 0) {
+        errnoPrint("Unable to start handshake reaper timer");
+        return -2;
+    }
+    return 0;
+}
+
+static void handleNewConnection(int client_sock) {
+    mutexLock(&handshakeMutex);
+    if (retired) {
+        // Accepted just before the listen socket was handed over
+        handOffSocket(HANDOFF_WAITING, client_sock, -1, -1, NULL, NULL, 0, NULL, 0);
+        close(client_sock);
+        mutexUnlock(&handshakeMutex);
+        return;
+    }
+    switch (admitConnection(client_sock, getUsedSlotCount())) {
+        case ADMISSION_LOGIN:
+            startHandshake(client_sock);
+            break;
+        case ADMISSION_WAIT:
+            infoPrint("Connection on socket %d is waiting for a free slot (%d waiting)", client_sock,
+                      getWaitingConnectionCount());
+            break;
+        default:
+            shedConnection(client_sock, "Maximum user amount reached, please try again later...");
+            break;
+    }
+    mutexUnlock(&handshakeMutex);
+}
+
+//return NULL if the login could not be started, then the socket is closed (the handshake mutex has to be locked)
+static HANDSHAKE *startHandshake(int client_sock) {
+    // Take a free handshake slot, the login request is read as soon as it arrives
+    HANDSHAKE *handshake = findHandshake(-1);
+    if (handshake == NULL) {
+        shedConnection(client_sock, "Too many pending logins, please try again later...");
+        return NULL;
+    }
+    handshake->state = HANDSHAKE_STATE_ACCEPTED;
+    handshake->clientSocket = client_sock;
+    insertHashIndex(&handshakeSocketIndex, hashInt(client_sock), (int) (handshake - handshakes));
+    handshake->channel = NULL;
+    handshake->received = 0;
+
+    // Only local clients may attach a shared memory channel
+    struct sockaddr_storage address;
+    socklen_t addressLength = sizeof(address);
+    handshake->local = getsockname(client_sock, (struct sockaddr *) &address, &addressLength) == 0
+                       && address.ss_family == AF_UNIX;
+    clock_gettime(CLOCK_MONOTONIC, &handshake->deadline);
+    handshake->deadline.tv_sec += HANDSHAKE_TIMEOUT_SECONDS;
+
+    if (reactorAddHandshake(client_sock, handleHandshakeData) < 0) {
+        errorPrint("Could not watch login of socket %d", client_sock);
+        closeHandshake(handshake);
+        return NULL;
+    }
+    handshake->state = HANDSHAKE_STATE_AWAITING_LOGIN;
+    return handshake;
+}
+
+static void shedConnection(int client_sock, char *reason) {
+    MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL, reason);
+    if (sendMessage(client_sock, &errorWarning) < 0) {
+        errorPrint("Unable to send rejection error warning to socket %d!", client_sock);
+    }
+    errorPrint("Rejected connection on socket %d: %s", client_sock, reason);
+    close(client_sock);
+}
+
+//Slots are taken by logged in and queued users and running logins, the handshake mutex has to be locked
+static int getUsedSlotCount() {
+    return getTotalUserAmount() + getQueuedLoginCount() + getHandshakeCount();
+}
+
+//The handshake mutex has to be locked
+static int getHandshakeCount() {
+    int handshakeCount = 0;
+    for (int i = 0; i < handshakeCapacity; i++) {
+        if (handshakes[i].state != HANDSHAKE_STATE_FREE) {
+            handshakeCount++;
         }
-        // Print error
-        if (client_sock < 0) {
-            errorPrint("Could not accept client connection");
-            return -1;
+    }
+    return handshakeCount;
+}
+
+//return > 0 while the login request is not complete
+static int handleHandshakeData(int client_sock) {
+    mutexLock(&handshakeMutex);
+    HANDSHAKE *handshake = findHandshake(client_sock);
+    if (handshake == NULL || handshake->state != HANDSHAKE_STATE_AWAITING_LOGIN) {
+        mutexUnlock(&handshakeMutex);
+        return 0;
+    }
+
+    // Only read up to the end of the login request, everything after it belongs to the reactor
+    MESSAGE message;
+    ssize_t unpacked = unpackMessage(handshake->buffer, handshake->received, &message);
+    size_t missing = handshake->received < sizeof(HEADER)
+                     ? sizeof(HEADER) - handshake->received
+                     : sizeof(HEADER) + message.header.length - handshake->received;
+    if (unpacked == 0) {
+        ssize_t readSize = receiveHandshakeData(handshake, missing);
+        if (readSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            mutexUnlock(&handshakeMutex);
+            return 1;
+        } else if (readSize <= 0) {
+            errorPrint("Error: Connection closed before login request was received");
+            closeHandshake(handshake);
+            mutexUnlock(&handshakeMutex);
+            admitWaitingConnections();
+            return 0;
         }
+        handshake->received += readSize;
+        unpacked = unpackMessage(handshake->buffer, handshake->received, &message);
+    }
+
+    if (unpacked == 0) {
+        mutexUnlock(&handshakeMutex);
+        return 1;
+    } else if (unpacked < 0 || validateMessage(&message) < 0) {
+        errorPrint("Error: Message not received or malformed");
+        closeHandshake(handshake);
+        mutexUnlock(&handshakeMutex);
+        admitWaitingConnections();
+        return 0;
+    }
+
+    // The login request is complete, from now on the reactor receives on this socket.
+    // The slot stays taken until the login is done, but the socket may be closed and reused meanwhile.
+    forgetHandshakeSocket(handshake);
+    handshake->state = HANDSHAKE_STATE_AUTHENTICATED;
+    reactorRemoveHandshake(client_sock);
+    mutexUnlock(&handshakeMutex);
+
+    handleLoginRequest(client_sock, &message);
+
+    mutexLock(&handshakeMutex);
+    handshake->state = HANDSHAKE_STATE_FREE;
+    mutexUnlock(&handshakeMutex);
 
-        if (getUserAmount() >= MAXUSERS || loginIsEnable >= 0) {
-            MESSAGE errorWarning = buildErrorWarning(
-                    ERROR_WARNING_TYPE_FATAL,
-                    "Game running or maximum user amount reached, please try again later...");
-            if (sendMessage(client_sock, &errorWarning) < 0) {
-                errorPrint("Unable to send game running or maximum users reached error warning!");
+    // A failed login frees its slot again
+    admitWaitingConnections();
+    return 0;
+}
+
+//Reads like recv(), from the shared memory channel if the local client has attached one
+static ssize_t receiveHandshakeData(HANDSHAKE *handshake, size_t missing) {
+    int client_sock = handshake->clientSocket;
+    char *target = handshake->buffer + handshake->received;
+
+    if (handshake->channel != NULL) {
+        // The ring is read before the doorbell, so a doorbell for data after the login is left for the reactor
+        size_t readSize = readSharedMemoryRing(&handshake->channel->toServer, target, missing, client_sock);
+        if (readSize == 0) {
+            if (drainSharedMemoryDoorbell(client_sock) < 0) {
+                return 0;
             }
-            errorPrint("Game running or maximum user amount reached, please try again later...");
-            continue;
+            readSize = readSharedMemoryRing(&handshake->channel->toServer, target, missing, client_sock);
         }
+        if (readSize == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        return (ssize_t) readSize;
+    }
 
-        MESSAGE message;
-        char username[USERNAMELENGTH];
+    if (handshake->local && handshake->received == 0) {
+        // The first byte tells if a local client wants to attach its shared memory
+        ssize_t readSize = receiveSharedMemoryAttach(client_sock, target, 1, &handshake->channel);
+        if (readSize != 1 || target[0] != SHM_ATTACH_REQUEST) {
+            return readSize;
+        }
+        if (handshake->channel == NULL) {
+            errorPrint("Local client on socket %d sent no usable shared memory", client_sock);
+            return 0;
+        }
+        if (reactorAttachChannel(client_sock, handshake->channel) < 0) {
+            errorPrint("Could not attach shared memory of socket %d (only the epoll backend supports it)",
+                       client_sock);
+            unmapSharedMemoryChannel(handshake->channel);
+            handshake->channel = NULL;
+            return 0;
+        }
+        infoPrint("Local client on socket %d uses shared memory", client_sock);
+        return receiveHandshakeData(handshake, missing);
+    }
 
-        if (receiveMessage(client_sock, &message) < 0 && validateMessage(&message) < 0) {
-            errorPrint("Error: Message not received or malformed");
-            continue;
+    return recv(client_sock, target, missing, MSG_DONTWAIT);
+}
+
+static void handleLoginRequest(int client_sock, MESSAGE *message) {
+    char username[USERNAMELENGTH];
 
+    if (message->header.type != TYPE_LOGIN_REQUEST) {
+        errorPrint("Error: Message received but type not login request");
+        closeClientSocket(client_sock);
+        return;
+    }
+
+    if (isMatchmakingEnabled()) {
+        // The login response waits for the match, the client does not send anything before
+        int queued = enqueueLogin(client_sock, message);
+        if (queued == -2) {
+            handOffQueuedLogin(client_sock, message);
+        } else if (queued < 0) {
+            closeClientSocket(client_sock);
         }
+        return;
+    }
+
+    memcpy(username, message->body.loginRequest.name, USERNAMELENGTH);
+
+    int clientID = addUser(username, client_sock);
+    if (finishLogin(clientID, client_sock, message) < 0) {
+        return;
+    }
+
+    // A login that was still running when the lobby moved to the successor follows it
+    mutexLock(&handshakeMutex);
+    int followLobby = retired;
+    mutexUnlock(&handshakeMutex);
+    int roomId = getRoomIdOfUser(clientID);
+    lockRoom(roomId);
+    followLobby = followLobby && getRoom(roomId)->gameState == GAME_STATE_PREPARATION;
+    unlockRoom(roomId);
+    if (followLobby) {
+        handOffLobbyUser(clientID);
+    }
+}
+
+//Answers the login of a user that has got its seat, return -1 if the user is gone again
+static int finishLogin(int clientID, int client_sock, MESSAGE *message) {
+    if (clientID < 0) {
+        errorPrint("Error: User could not be added to user data");
+        closeClientSocket(client_sock);
+        return -1;
+    }
+
+    //Message send, the client knows only its seat in the room
+    int roomId = getRoomIdOfUser(clientID);
+    MESSAGE sendmessage = buildLoginResponseOk(message->body.loginRequest.rfcVersion, (uint8_t) getRoomCapacity(),
+                                               (__uint8_t) getSeatOfUser(clientID));
+
+    if (sendMessage(client_sock, &sendmessage) < 0) {
+        errorPrint("Error: Message send failure");
+        removeUser(clientID);
+        closeClientSocket(client_sock);
+        return -1;
+    }
+
+    // Notify the score agent manually here, because the score agent sends messages to all players
+    // which results in an unexpected behaviour in the client because it needs the login response ok first!
+    // Note that lasted 6h to figure out!
+    notifyScoreAgent(roomId);
 
-        if (message.header.type != TYPE_LOGIN_REQUEST) {
-            errorPrint("Error: Message received but type not login request");
-            continue;
+    printUSERDATA(roomId);
+    startClientHandling(clientID, NULL);
+    return 0;
+}
+
+//Runs in the matchmaker thread, the group gets a room of its own and its leader starts the game right away
+static void startMatch(MATCH_TICKET *group, int playerCount) {
+    int roomId = lockNewRoom();
+    if (roomId < 0) {
+        errorPrint("Error: All rooms are taken, a match of %d players is not possible!", playerCount);
+        for (MATCH_TICKET *ticket = group; ticket != NULL; ticket = ticket->next) {
+            shedConnection(ticket->clientSocket, "Maximum numbers of User reached, adding Username not possible!");
         }
+        admitWaitingConnections();
+        return;
+    }
+    unlockRoom(roomId);
 
-        memcpy(username, message.body.loginRequest.name, USERNAMELENGTH);
+    int leaderID = -1;
+    for (MATCH_TICKET *ticket = group; ticket != NULL; ticket = ticket->next) {
+        char username[USERNAMELENGTH];
+        memcpy(username, ticket->loginRequest.body.loginRequest.name, USERNAMELENGTH);
+        int clientID = addMatchedUser(roomId, username, ticket->clientSocket);
+        if (finishLogin(clientID, ticket->clientSocket, &ticket->loginRequest) == 0 && leaderID < 0) {
+            leaderID = clientID;
+        }
+    }
 
-        if (addUser(username, client_sock) < 0) {
-            errorPrint("Error: User could not be added to user data");
-            continue;
+    // The start is handled by the actor of the room like one sent by the leader, it fails if too few are left
+    infoPrint("Matched %d players into room %d", playerCount, roomId);
+    if (leaderID >= 0) {
+        // A start sent by a client gets its name terminated by fixRFCBody(), this one has to bring its terminator
+        MESSAGE startGame = {0};
+        startGame.header.type = TYPE_START_GAME;
+        startGame.header.length = (uint16_t) strlen(matchCatalogName);
+        memcpy(startGame.body.startGame.catalog, matchCatalogName, strlen(matchCatalogName) + 1);
+        if (postRoomCommand(ROOM_COMMAND_MESSAGE, roomId, leaderID, getUser(leaderID).clientSocket, &startGame) < 0) {
+            errorPrint("Could not start the game of the match in room %d!", roomId);
         }
+    } else {
+        releaseRoomIfEmpty(roomId);
+    }
 
-        //Message send
-        int clientID = getUserIdByClientSocket(client_sock);
-        //infoPrint("Client-ID: %d",clientID);
-        MESSAGE sendmessage = buildLoginResponseOk(message.body.loginRequest.rfcVersion, MAXUSERS,
-                                                   (__uint8_t) clientID);
+    // Logins that failed have freed their slots
+    admitWaitingConnections();
+}
 
-        if (sendMessage(client_sock, &sendmessage) < 0) {
-            errorPrint("Error: Message send failure");
-            continue;
+//A queued login goes to the successor like a handshake that has received its login request
+static void handOffQueuedLogin(int client_sock, MESSAGE *message) {
+    WIRE_FRAME *wire = encodeMessage(message);
+    if (wire == NULL || handOffSocket(HANDOFF_HANDSHAKE, client_sock, -1, -1, NULL, wire->data, wire->length,
+                                      NULL, 0) < 0) {
+        errorPrint("Could not hand the queued login on socket %d over to the successor", client_sock);
+    }
+    if (wire != NULL) {
+        releaseWireFrame(wire);
+    }
+    closeClientSocket(client_sock);
+}
+
+//Lookup of the handshake slot of a socket (-1 for a free slot), the handshake mutex has to be locked
+static HANDSHAKE *findHandshake(int client_sock) {
+    if (client_sock >= 0) {
+        int handshakeIndex = findHashIndex(&handshakeSocketIndex, hashInt(client_sock), isSocketOfHandshake,
+                                           &client_sock, NULL);
+        return handshakeIndex >= 0 ? &handshakes[handshakeIndex] : NULL;
+    }
+    for (int i = 0; i < handshakeCapacity; i++) {
+        if (handshakes[i].state == HANDSHAKE_STATE_FREE) {
+            return &handshakes[i];
         }
+    }
+    return NULL;
+}
+
+static int isSocketOfHandshake(int handshakeIndex, const void *client_sock, void *context) {
+    (void) context;
+    return handshakes[handshakeIndex].clientSocket == *(const int *) client_sock;
+}
+
+//The handshake mutex has to be locked
+static void forgetHandshakeSocket(HANDSHAKE *handshake) {
+    removeHashIndex(&handshakeSocketIndex, hashInt(handshake->clientSocket), (int) (handshake - handshakes));
+}
+
+//The handshake mutex has to be locked
+static void closeHandshake(HANDSHAKE *handshake) {
+    forgetHandshakeSocket(handshake);
+    if (handshake->state == HANDSHAKE_STATE_AWAITING_LOGIN) {
+        reactorRemoveHandshake(handshake->clientSocket);
+    }
+    closeClientSocket(handshake->clientSocket);
+    handshake->state = HANDSHAKE_STATE_FREE;
+}
+
+static void closeClientSocket(int client_sock) {
+    // An attached shared memory channel belongs to the descriptor, which may be reused at once
+    reactorDetachChannel(client_sock);
+    close(client_sock);
+}
+
+static void reapHandshakes(union sigval value) {
+    (void) value;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    mutexLock(&handshakeMutex);
+    for (int i = 0; i < handshakeCapacity; i++) {
+        HANDSHAKE *handshake = &handshakes[i];
+        if ((handshake->state == HANDSHAKE_STATE_ACCEPTED || handshake->state == HANDSHAKE_STATE_AWAITING_LOGIN)
+            && (now.tv_sec > handshake->deadline.tv_sec
+                || (now.tv_sec == handshake->deadline.tv_sec && now.tv_nsec >= handshake->deadline.tv_nsec))) {
+            errorPrint("Login on socket %d timed out, closing connection", handshake->clientSocket);
+            closeHandshake(handshake);
+        }
+    }
+    mutexUnlock(&handshakeMutex);
+
+    admitWaitingConnections();
+}
+
+//The handshake mutex has to be locked
+static void handOffHandshake(HANDSHAKE *handshake) {
+    if (handshake->channel != NULL) {
+        // The shared memory of a local client cannot follow its socket, so it has to connect again
+        MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL, "Server has been upgraded, please connect again!");
+        sendMessage(handshake->clientSocket, &errorWarning);
+        closeHandshake(handshake);
+        return;
+    }
+
+    forgetHandshakeSocket(handshake);
+    reactorRemoveHandshake(handshake->clientSocket);
+    handOffSocket(HANDOFF_HANDSHAKE, handshake->clientSocket, -1, -1, NULL, handshake->buffer, handshake->received,
+                  NULL, 0);
+    close(handshake->clientSocket);
+    handshake->state = HANDSHAKE_STATE_FREE;
+}
+
+//return 0 if the reactor releases the user, handOffReleasedUser() passes it on then
+static int handOffLobbyUser(int userId) {
+    int client_sock = getUser(userId).clientSocket;
+    int result = reactorReleaseClient(client_sock, handOffReleasedUser);
+    if (result == -2) {
+        // Like above, the reactor disconnects the user as usual
+        MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL, "Server has been upgraded, please connect again!");
+        sendMessage(client_sock, &errorWarning);
+        shutdown(client_sock, SHUT_RDWR);
+    }
+    return result;
+}
 
-        // Notify the score agent manually here, because the score agent sends messages to all players
-        // which results in an unexpected behaviour in the client because it needs the login response ok first!
-        // Note that lasted 6h to figure out!
-        notifyScoreAgent();
+static void handOffReleasedUser(int client_sock, int userId, RECEIVE_BUFFER *received, SEND_QUEUE *unsent) {
+    // Nobody may queue messages for the user anymore, so it is removed first
+    USER user = getUser(userId);
+    int roomId = getRoomIdOfUser(userId);
+    int seat = getSeatOfUser(userId);
+    removeUser(userId);
 
-        printUSERDATA();
-        startClientThread(clientID);
+    char receivedData[RECEIVE_BUFFER_SIZE];
+    size_t receivedLength = copyUnhandledData(received, receivedData);
+    char *unsentData = malloc(unsent->queuedBytes + 1);
+    size_t unsentLength = unsentData != NULL ? takeUnsentData(unsent, unsentData) : 0;
+    if (handOffSocket(HANDOFF_USER, client_sock, roomId, seat, user.username, receivedData, receivedLength,
+                      unsentData, unsentLength) < 0) {
+        errorPrint("Could not hand user %s (%d) over to the successor", user.username, userId);
+    } else {
+        infoPrint("Handed user %s (%d) over to the successor", user.username, userId);
+    }
+    free(unsentData);
+
+    mutexLock(&handshakeMutex);
+    checkRetirement();
+    mutexUnlock(&handshakeMutex);
+}
+
+//The handshake mutex has to be locked
+static void checkRetirement() {
+    if (!retired) {
+        return;
+    }
+
+    // The successor starts accepting once no lobby user is left here
+    if (!handOffFinished && getRoomUserCount(GAME_STATE_PREPARATION) == 0) {
+        handOffFinished = 1;
+        handOffSocket(HANDOFF_DONE, -1, -1, -1, NULL, NULL, 0, NULL, 0);
+    }
+    // Players of finished games only look at their results, they do not keep the server alive
+    if (handOffFinished && getRoomUserCount(GAME_STATE_GAME_RUNNING) == 0 && getHandshakeCount() == 0) {
+        infoPrint("Everything has been handed over to the successor, shutting down...");
+        cancelMainThread();
     }
 }
@@ -9,12 +9,32 @@
 #ifndef LOGIN_H
 #define LOGIN_H
 
-int serverSocketFileDescriptor;
+#include <sys/types.h>
+#include "receivebuffer.h"
 
-int startLoginThread(int *port);
+int initLogin(int waitingCapacity, int connectionLimit);
 
-void enableLogin();
+int startMatchmaking(char *catalogName, int waitSeconds);
 
-void disableLogin();
+int startLogin(int port, /* nullable */ char *localPath, int backlog);
+
+int inheritListenSocket(int listenSocket, /* nullable */ char *localPath);
+
+void closeLoginSockets();
+
+void admitWaitingConnections();
+
+void retireLogin();
+
+int isLoginRetired();
+
+void checkLoginRetirement();
+
+void adoptWaitingConnection(int client_sock);
+
+void adoptHandshake(int client_sock, const char *received, size_t length);
+
+int adoptLobbyUser(int client_sock, int roomId, int seat, char *username, RECEIVE_BUFFER *received, const char *unsent,
+                   size_t unsentLength);
 
 #endif
@@ -10,13 +10,21 @@
  * (gegebenenfalls auch durch Aufruf von Funktionen aus anderen Modulen)
  * Initialisierungen durch. Außerdem starten Sie hier den Login und den
  * Score-Agent. Auch die Überprüfung (mittels Lock-File), ob bereits eine
- * Instanz des Servers läuft, erfolgt hier.
+ * Instanz des Servers läuft, erfolgt hier. Existiert das Lock-File und ist ein
+ * Upgrade-Socket angegeben, übernimmt der neue Server den laufenden (upgrade.c).
+ * Ein Server hostet bis zu maxRooms Spiele gleichzeitig (room.c), wie viele
+ * Spieler in einen Raum passen, legt roomCapacity fest.
+ * Mit einem Katalog für das Matchmaking teilt der Server die Spieler selbst in
+ * Räume ein und startet die Spiele (matchmaker.c).
+ * Mit synchronen Runden bekommen alle Spieler eines Raumes jede Frage zugleich
+ * (clientthread.c).
  */
 #include <stdlib.h>
 #include <getopt.h>
 #include <unistd.h>
 #include <libgen.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/signal.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -27,6 +35,14 @@
 #include "threadholder.h"
 #include "catalog.h"
 #include "clientthread.h"
+#include "reactor.h"
+#include "sendqueue.h"
+#include "upgrade.h"
+#include "room.h"
+#include "usertimer.h"
+#include "user.h"
+#include "rfc.h"
+#include "vardefine.h"
 
 //------------------------------------------------------------------------------
 // Types
@@ -37,6 +53,20 @@ typedef struct {
     char *catalogPath;
     char *loaderPath;
     int port;
+    char *localPath;
+    int reactorBackend;
+    int reactorCount;
+    int actorCount;
+    int slowConsumerPolicy;
+    int listenBacklog;
+    int waitingConnections;
+    int maxConnections;
+    int maxRooms;
+    int roomCapacity;
+    char *upgradePath;
+    char *matchCatalog;
+    int matchWaitSeconds;
+    int synchronizedRounds;
 } CONFIGURATION;
 
 //------------------------------------------------------------------------------
@@ -52,8 +82,6 @@ static void printUsage();
 
 static int createLockFile();
 
-static void closeServerSocket();
-
 static void removeLockFile();
 
 // TODO FEEDBACK Nächste Abgabe: Was passiert wenn ein Thread ein MUTEX hält?
@@ -100,6 +128,20 @@ int main(int argc, char **argv) {
     infoPrint("    Catalog-path:\t%s", config.catalogPath);
     infoPrint("    Loader-path:\t%s", config.loaderPath);
     infoPrint("    Port:\t\t%d", config.port);
+    infoPrint("    Local socket:\t%s", config.localPath != NULL ? config.localPath : "-");
+    infoPrint("    I/O backend:\t%s", config.reactorBackend == REACTOR_BACKEND_IO_URING ? "io_uring" : "epoll");
+    infoPrint("    Reactors:\t%d", config.reactorCount);
+    infoPrint("    Room actors:\t%d", config.actorCount);
+    infoPrint("    Slow clients:\t%s", config.slowConsumerPolicy == SLOW_CONSUMER_POLICY_DROP ? "drop" : "summary");
+    infoPrint("    Listen backlog:\t%d", config.listenBacklog);
+    infoPrint("    Waiting queue:\t%d", config.waitingConnections);
+    infoPrint("    Connections:\t%d", config.maxConnections);
+    infoPrint("    Rooms:\t\t%d", config.maxRooms);
+    infoPrint("    Players per room:\t%d", config.roomCapacity);
+    infoPrint("    Upgrade socket:\t%s", config.upgradePath != NULL ? config.upgradePath : "-");
+    infoPrint("    Matchmaking:\t%s", config.matchCatalog != NULL ? config.matchCatalog : "-");
+    infoPrint("    Match wait:\t%d s", config.matchWaitSeconds);
+    infoPrint("    Rounds:\t\t%s", config.synchronizedRounds ? "synchronized" : "per player");
     if (!parseArgumentsResult || validateArgumentsResult != 0) {
         printUsage();
         infoPrint("Exiting...");
@@ -108,9 +150,14 @@ int main(int argc, char **argv) {
 
     // Lock file handling
     int createLockFileResult = createLockFile();
+    int takeOver = 0;
     if (createLockFileResult < 0) {
         errorPrint("Could not open lock file! Exiting...");
         exit(1);
+    } else if (createLockFileResult == 0 && config.upgradePath != NULL) {
+        // The lock file stays, it belongs to us once the running server has exited
+        infoPrint("Lock file exists (%s), taking over from the running server...", LOCK_FILE);
+        takeOver = 1;
     } else if (createLockFileResult == 0) {
         errorPrint("Lock file exists (%s)! Cannot start more than one server at once! Exiting...", LOCK_FILE);
         exit(1);
@@ -121,8 +168,15 @@ int main(int argc, char **argv) {
     // Error indicator
     int hasError = 0;
 
-    // Initialize modules
-    if (initializeClientThreadModule() < 0) {
+    // Initialize modules, the rooms and timers first because everything else works on them
+    int userCapacity = config.maxRooms * config.roomCapacity;
+    if (initRooms(config.maxRooms, config.roomCapacity) < 0 || initUsers(userCapacity) < 0
+        || initUserTimers(userCapacity) < 0 || initRoomTimers(config.maxRooms) < 0) {
+        errorPrint("Could not initialize the rooms");
+        hasError = 1;
+    }
+    if (!hasError && initializeClientThreadModule(config.reactorBackend, config.reactorCount, config.actorCount,
+                                                  config.slowConsumerPolicy, config.synchronizedRounds) < 0) {
         errorPrint("Could not initialize");
         hasError = 1;
     }
@@ -136,14 +190,36 @@ int main(int argc, char **argv) {
         errorPrint("Cannot fetch catalogs!");
         hasError = 1;
     }
-    if (!hasError && startLoginThread(&config.port) < 0) {
-        errorPrint("Cannot start login thread!");
+    if (!hasError && initLogin(config.waitingConnections, config.maxConnections) < 0) {
+        errorPrint("Cannot initialize login!");
+        hasError = 1;
+    }
+    if (!hasError && config.matchCatalog != NULL
+        && startMatchmaking(config.matchCatalog, config.matchWaitSeconds) < 0) {
+        errorPrint("Cannot start matchmaking!");
         hasError = 1;
     }
     if (!hasError && startScoreAgentThread() < 0) {
         errorPrint("Cannot start score agent thread!");
         hasError = 1;
     }
+    if (!hasError && takeOver && takeOverPredecessor(config.upgradePath) < 0) {
+        errorPrint("Cannot take over from the running server!");
+        hasError = 1;
+    }
+    int ownsLockFile = !takeOver || !hasError;
+    if (!hasError && startLogin(config.port, config.localPath, config.listenBacklog) < 0) {
+        errorPrint("Cannot start login!");
+        hasError = 1;
+    }
+    if (!hasError && config.upgradePath != NULL && startUpgradeListener(config.upgradePath) < 0) {
+        errorPrint("Cannot wait for a successor!");
+        hasError = 1;
+    }
+    if (!hasError && takeOver && startHandOffReceiver() < 0) {
+        errorPrint("Cannot take over connections from the running server!");
+        hasError = 1;
+    }
 
     // Shutdown handling:
     // Until a terminating signal the server main-thread shell wait
@@ -166,9 +242,14 @@ int main(int argc, char **argv) {
     }
 
     // Shut the server down properly
+    drainReactor();
     cancelAllServerThreads();
-    closeServerSocket();
-    removeLockFile();
+    closeLoginSockets();
+    closeUpgradeSocket();
+    // After an upgrade the successor keeps running with the lock file
+    if (ownsLockFile && !isLoginRetired()) {
+        removeLockFile();
+    }
     infoPrint("(Shutdown server) Exiting...");
     return 0;
 }
@@ -178,6 +259,20 @@ static CONFIGURATION initConfiguration() {
     config.catalogPath = "";
     config.loaderPath = "";
     config.port = 0;
+    config.localPath = NULL;
+    config.reactorBackend = REACTOR_BACKEND_EPOLL;
+    config.reactorCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    config.actorCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    config.slowConsumerPolicy = SLOW_CONSUMER_POLICY_SUMMARY;
+    config.listenBacklog = DEFAULTLISTENBACKLOG;
+    config.waitingConnections = DEFAULTWAITINGCONNECTIONS;
+    config.maxConnections = DEFAULTMAXCONNECTIONS;
+    config.maxRooms = DEFAULTMAXROOMS;
+    config.roomCapacity = DEFAULTROOMCAPACITY;
+    config.upgradePath = NULL;
+    config.matchCatalog = NULL;
+    config.matchWaitSeconds = DEFAULTMATCHWAITSECONDS;
+    config.synchronizedRounds = 0;
     return config;
 }
 
@@ -187,27 +282,75 @@ static int parseArguments(int argc, char **argv, CONFIGURATION *config) {
     int portSet = 0;
 
     int param;
-    while ((param = getopt(argc, argv, "c:l:p:dm")) != -1) {
+    while ((param = getopt(argc, argv, "a:b:c:H:l:M:p:P:q:r:R:s:U:w:x:dmSu")) != -1) {
         switch (param) {
+            case 'a':
+                config->actorCount = atoi(optarg);
+                break;
+            case 'b':
+                config->listenBacklog = atoi(optarg);
+                break;
             case 'c':
                 config->catalogPath = optarg;
                 categorySet = 1;
                 break;
+            case 'H':
+                config->upgradePath = optarg;
+                break;
             case 'l':
                 config->loaderPath = optarg;
                 loaderSet = 1;
                 break;
+            case 'M':
+                config->matchCatalog = optarg;
+                break;
             case 'p':
                 // NOTE FEEDBACK atoi() kann schief gehen. Benutz strtoul (siehe man, schmeißt Fehler)
                 config->port = atoi(optarg);
                 portSet = 1;
                 break;
+            case 'P':
+                config->roomCapacity = atoi(optarg);
+                break;
+            case 'q':
+                config->waitingConnections = atoi(optarg);
+                break;
+            case 'r':
+                config->reactorCount = atoi(optarg);
+                break;
+            case 'R':
+                config->maxRooms = atoi(optarg);
+                break;
+            case 's':
+                if (strcmp(optarg, "drop") == 0) {
+                    config->slowConsumerPolicy = SLOW_CONSUMER_POLICY_DROP;
+                } else if (strcmp(optarg, "summary") == 0) {
+                    config->slowConsumerPolicy = SLOW_CONSUMER_POLICY_SUMMARY;
+                } else {
+                    return -1;
+                }
+                break;
+            case 'U':
+                config->localPath = optarg;
+                break;
+            case 'w':
+                config->matchWaitSeconds = atoi(optarg);
+                break;
+            case 'x':
+                config->maxConnections = atoi(optarg);
+                break;
             case 'd':
                 debugEnable();
                 break;
             case 'm':
                 styleDisable();
                 break;
+            case 'S':
+                config->synchronizedRounds = 1;
+                break;
+            case 'u':
+                config->reactorBackend = REACTOR_BACKEND_IO_URING;
+                break;
             default:
                 // Fail safe check (because only allowed arguments shell get checked)
                 return -1;
@@ -252,16 +395,63 @@ static int validateConfiguration(CONFIGURATION *config) {
         return -6;
     }
 
+    // Validate reactor and actor count
+    if (config->reactorCount <= 0 || config->actorCount <= 0) {
+        errorPrint("Reactor and room actor count must be greater than zero!");
+        return -7;
+    }
+
+    // Validate admission limits
+    if (config->listenBacklog <= 0 || config->waitingConnections < 0 || config->maxConnections <= 0) {
+        errorPrint("Backlog and connection limit must be greater than zero, the waiting queue must not be negative!");
+        return -8;
+    }
+
+    // Validate room count
+    if (config->maxRooms <= 0) {
+        errorPrint("Room count must be greater than zero!");
+        return -9;
+    }
+
+    // Validate room capacity, the RFC has one byte for the players
+    if (config->roomCapacity < MINUSERS || config->roomCapacity > RFC_PLAYER_COUNT_MAXIMUM) {
+        errorPrint("Players per room must be between %d and %d!", MINUSERS, RFC_PLAYER_COUNT_MAXIMUM);
+        return -10;
+    }
+
+    // Validate the wait of the matchmaking
+    if (config->matchWaitSeconds < 0) {
+        errorPrint("Match wait must not be negative!");
+        return -11;
+    }
+
     return 0;
 }
 
 static void printUsage() {
-    errorPrint("Usage:  %s -c CATALOG_PATH -l LOADER_PATH -p PORT [-d] [-m]", getProgName());
+    errorPrint("Usage:  %s -c CATALOG_PATH -l LOADER_PATH -p PORT [-r REACTORS] [-a ACTORS] [-s drop|summary] [-b BACKLOG] [-q WAITING] [-x CONNECTIONS] [-R ROOMS] [-P PLAYERS] [-U SOCKET_PATH] [-H UPGRADE_PATH] [-M CATALOG] [-w SECONDS] [-S] [-d] [-m] [-u]",
+               getProgName());
     errorPrint("        -c        Specify catalog direct. Required.");
     errorPrint("        -l        Specify loader executable. Required.");
     errorPrint("        -p        Specify port. Required");
+    errorPrint("        [-r]      Number of reactor threads (default: number of CPUs)");
+    errorPrint("        [-a]      Number of room actor threads that run the games (default: number of CPUs)");
+    errorPrint("        [-s]      Disconnect slow clients (drop) or send them only the newest player list (summary, default)");
+    errorPrint("        [-b]      Listen backlog (default: %d)", DEFAULTLISTENBACKLOG);
+    errorPrint("        [-q]      Connections that may wait for a free slot (default: %d)", DEFAULTWAITINGCONNECTIONS);
+    errorPrint("        [-x]      Maximum of all connections, more are rejected (default: %d)", DEFAULTMAXCONNECTIONS);
+    errorPrint("        [-R]      Maximum of games running at once (default: %d)", DEFAULTMAXROOMS);
+    errorPrint("        [-P]      Maximum of players per room (default: %d, at most %d)", DEFAULTROOMCAPACITY,
+               RFC_PLAYER_COUNT_MAXIMUM);
+    errorPrint("        [-U]      Also listen on a unix socket, local clients may use shared memory there");
+    errorPrint("        [-H]      Wait for a successor on this unix socket, or take over if a server is running");
+    errorPrint("        [-M]      Put players into rooms automatically, the games start with this catalog");
+    errorPrint("        [-w]      Seconds a player waits for a full room before playing with fewer (default: %d)",
+               DEFAULTMATCHWAITSECONDS);
+    errorPrint("        [-S]      Synchronized rounds, all players of a room get each question at the same time");
     errorPrint("        [-d]      Enable debug output");
     errorPrint("        [-m]      Disable colors in debug output");
+    errorPrint("        [-u]      Use io_uring instead of epoll for client I/O");
 }
 
 static int createLockFile() {
@@ -280,11 +470,6 @@ static int createLockFile() {
     }
 }
 
-static void closeServerSocket() {
-    infoPrint("Closing server socket");
-    close(serverSocketFileDescriptor);
-}
-
 static void removeLockFile() {
     int removal = unlink(LOCK_FILE);
     if (removal < 0) {
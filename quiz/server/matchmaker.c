@@ -0,0 +1,348 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * matchmaker.c: Implementierung des Matchmakings
+ *
+ * Die Warteschlange ist eine einfach verkettete Liste mit Anfang und Ende, ein
+ * Client wird in O(1) angehängt und vorne entnommen. Der Thread wird bei jedem
+ * neuen Client geweckt und sonst spätestens, wenn die Wartezeit des ältesten
+ * abläuft, solange Clients warten aber mindestens jede Sekunde. Clients, die
+ * die Verbindung schon getrennt haben, werden dabei verworfen und geben ihren
+ * Platz frei. Eine Gruppe, die dadurch zu klein wird, kommt wieder an den
+ * Anfang der Warteschlange.
+ */
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "matchmaker.h"
+#include "reactor.h"
+#include "login.h"
+#include "threadholder.h"
+#include "mutexhelper.h"
+#include "vardefine.h"
+#include "../common/util.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+#define MATCH_SWEEP_INTERVAL_SECONDS 1
+
+typedef struct {
+    MATCH_TICKET *head; // The oldest ticket, groups are taken from here
+    MATCH_TICKET *tail; // The newest ticket, new logins are queued behind it
+    int length; // Also read without the lock by the admission
+} MATCH_QUEUE;
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static void *runMatchmaker(void *argument);
+
+static int dropLeftTickets();
+
+static MATCH_TICKET *takeGroup(int *playerCount);
+
+static int isGroupReady();
+
+static void requeueGroup(MATCH_TICKET *group, MATCH_TICKET *last, int playerCount);
+
+static MATCH_TICKET *dequeueTicket();
+
+static int isTicketConnected(MATCH_TICKET *ticket);
+
+static int hasWaitedLongEnough(MATCH_TICKET *ticket);
+
+static int getWaitDeadline(struct timespec *deadline);
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static pthread_t matchmakerThreadId = 0;
+static pthread_mutex_t queueMutex;
+static pthread_mutex_t matchMutex; // Held while a group gets its room, the retirement waits for it
+static sem_t matchmakerTrigger; // Posted for every queued login
+
+static MATCH_QUEUE queue = {NULL, NULL, 0};
+static int enabled = 0;
+static int retired = 0;
+
+static int matchGroupSize = 0;
+static int matchWaitSeconds = 0;
+static void (*onMatch)(MATCH_TICKET *group, int playerCount) = NULL;
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+//The callback gets the tickets of a group linked by next, they are freed after it returns
+int startMatchmaker(int groupSize, int waitSeconds, void (*startMatch)(MATCH_TICKET *group, int playerCount)) {
+    if (mutexInit(&queueMutex, NULL) < 0 || mutexInit(&matchMutex, NULL) < 0) {
+        errorPrint("Could not init the matchmaker MUTEX!");
+        return -1;
+    }
+    if (sem_init(&matchmakerTrigger, 0, 0) < 0) {
+        errnoPrint("Could not init the semaphore of the matchmaker");
+        return -2;
+    }
+    matchGroupSize = groupSize;
+    matchWaitSeconds = waitSeconds;
+    onMatch = startMatch;
+    enabled = 1;
+
+    if (pthread_create(&matchmakerThreadId, NULL, runMatchmaker, NULL) != 0) {
+        errorPrint("Could not start the matchmaker!");
+        enabled = 0;
+        return -3;
+    }
+    registerThread(matchmakerThreadId);
+    infoPrint("Started matchmaker for groups of %d players (waiting at most %d seconds)", groupSize, waitSeconds);
+    return 0;
+}
+
+int isMatchmakingEnabled() {
+    return enabled;
+}
+
+//return 0 if the login is queued, -1 without memory and -2 if the matchmaker has been retired
+int enqueueLogin(int clientSocket, const MESSAGE *loginRequest) {
+    MATCH_TICKET *ticket = malloc(sizeof(MATCH_TICKET));
+    if (ticket == NULL) {
+        errorPrint("No memory left to queue the login on socket %d!", clientSocket);
+        return -1;
+    }
+    ticket->next = NULL;
+    ticket->clientSocket = clientSocket;
+    clock_gettime(CLOCK_MONOTONIC, &ticket->queuedAt);
+    memcpy(&ticket->loginRequest, loginRequest, sizeof(MESSAGE));
+
+    mutexLock(&queueMutex);
+    if (retired) {
+        mutexUnlock(&queueMutex);
+        free(ticket);
+        return -2;
+    }
+    if (queue.tail != NULL) {
+        queue.tail->next = ticket;
+    } else {
+        queue.head = ticket;
+    }
+    queue.tail = ticket;
+    __atomic_add_fetch(&queue.length, 1, __ATOMIC_RELAXED);
+    mutexUnlock(&queueMutex);
+
+    debugPrint("Queued login on socket %d for matchmaking", clientSocket);
+    sem_post(&matchmakerTrigger);
+    return 0;
+}
+
+//Needs no lock, queued logins take a slot like logged in users
+int getQueuedLoginCount() {
+    return __atomic_load_n(&queue.length, __ATOMIC_RELAXED);
+}
+
+//Passes every queued login on, logins that come in later are refused by enqueueLogin()
+void retireMatchmaker(void (*handOffLogin)(int clientSocket, MESSAGE *loginRequest)) {
+    if (!enabled) {
+        return;
+    }
+    // A group that is just getting its room is finished first, it counts as lobby then
+    mutexLock(&matchMutex);
+    mutexLock(&queueMutex);
+    retired = 1;
+    MATCH_TICKET *ticket;
+    while ((ticket = dequeueTicket()) != NULL) {
+        handOffLogin(ticket->clientSocket, &ticket->loginRequest);
+        free(ticket);
+    }
+    mutexUnlock(&queueMutex);
+    mutexUnlock(&matchMutex);
+}
+
+static void *runMatchmaker(void *argument) {
+    (void) argument;
+    while (1) {
+        mutexLock(&matchMutex);
+        mutexLock(&queueMutex);
+        int leftCount = retired ? 0 : dropLeftTickets();
+        int playerCount = 0;
+        MATCH_TICKET *group = retired ? NULL : takeGroup(&playerCount);
+        struct timespec deadline;
+        int hasDeadline = getWaitDeadline(&deadline);
+        mutexUnlock(&queueMutex);
+
+        int matched = group != NULL;
+        if (matched) {
+            onMatch(group, playerCount);
+            while (group != NULL) {
+                MATCH_TICKET *next = group->next;
+                free(group);
+                group = next;
+            }
+        }
+        mutexUnlock(&matchMutex);
+
+        if (leftCount > 0) {
+            // The slots of the logins that have left are free for waiting connections
+            admitWaitingConnections();
+        }
+        if (matched) {
+            // The queue may hold the next group already
+            continue;
+        }
+
+        if (hasDeadline) {
+            sem_timedwait(&matchmakerTrigger, &deadline);
+        } else {
+            sem_wait(&matchmakerTrigger);
+        }
+    }
+    return NULL;
+}
+
+//return how many queued logins have left, their sockets are closed (the queue has to be locked)
+static int dropLeftTickets() {
+    int leftCount = 0;
+    MATCH_TICKET *previous = NULL;
+    MATCH_TICKET *ticket = queue.head;
+    while (ticket != NULL) {
+        MATCH_TICKET *next = ticket->next;
+        if (isTicketConnected(ticket)) {
+            previous = ticket;
+            ticket = next;
+            continue;
+        }
+        if (previous != NULL) {
+            previous->next = next;
+        } else {
+            queue.head = next;
+        }
+        if (queue.tail == ticket) {
+            queue.tail = previous;
+        }
+        __atomic_sub_fetch(&queue.length, 1, __ATOMIC_RELAXED);
+
+        infoPrint("Queued login on socket %d has left before its match", ticket->clientSocket);
+        reactorDetachChannel(ticket->clientSocket);
+        close(ticket->clientSocket);
+        free(ticket);
+        leftCount++;
+        ticket = next;
+    }
+    return leftCount;
+}
+
+//return the connected tickets of the next group, NULL if there is none yet (the queue has to be locked)
+static MATCH_TICKET *takeGroup(int *playerCount) {
+    if (!isGroupReady()) {
+        return NULL;
+    }
+
+    MATCH_TICKET *group = NULL;
+    MATCH_TICKET *last = NULL;
+    int count = 0;
+    while (count < matchGroupSize && queue.head != NULL) {
+        MATCH_TICKET *ticket = dequeueTicket();
+        if (!isTicketConnected(ticket)) {
+            infoPrint("Queued login on socket %d has left before its match", ticket->clientSocket);
+            reactorDetachChannel(ticket->clientSocket);
+            close(ticket->clientSocket);
+            free(ticket);
+            continue;
+        }
+        if (last != NULL) {
+            last->next = ticket;
+        } else {
+            group = ticket;
+        }
+        last = ticket;
+        count++;
+    }
+
+    // Players that have left make a group smaller, it may have to wait for more again
+    if (count < matchGroupSize && (count < MINUSERS || !hasWaitedLongEnough(group))) {
+        requeueGroup(group, last, count);
+        return NULL;
+    }
+    *playerCount = count;
+    return group;
+}
+
+//A room is full or the oldest login has waited long enough and may play with fewer (the queue has to be locked)
+static int isGroupReady() {
+    return queue.length >= matchGroupSize || (queue.length >= MINUSERS && hasWaitedLongEnough(queue.head));
+}
+
+//Puts the tickets back to the front in their order (the queue has to be locked)
+static void requeueGroup(MATCH_TICKET *group, MATCH_TICKET *last, int playerCount) {
+    if (group == NULL) {
+        return;
+    }
+    last->next = queue.head;
+    if (queue.head == NULL) {
+        queue.tail = last;
+    }
+    queue.head = group;
+    __atomic_add_fetch(&queue.length, playerCount, __ATOMIC_RELAXED);
+}
+
+//return the oldest ticket or NULL if the queue is empty (the queue has to be locked)
+static MATCH_TICKET *dequeueTicket() {
+    MATCH_TICKET *ticket = queue.head;
+    if (ticket == NULL) {
+        return NULL;
+    }
+    queue.head = ticket->next;
+    if (queue.head == NULL) {
+        queue.tail = NULL;
+    }
+    ticket->next = NULL;
+    __atomic_sub_fetch(&queue.length, 1, __ATOMIC_RELAXED);
+    return ticket;
+}
+
+//Nobody reads from a queued socket, a closed connection shows up as end of file
+static int isTicketConnected(MATCH_TICKET *ticket) {
+    char byte;
+    ssize_t peeked = recv(ticket->clientSocket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return peeked > 0 || (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+static int hasWaitedLongEnough(MATCH_TICKET *ticket) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec - ticket->queuedAt.tv_sec > matchWaitSeconds
+           || (now.tv_sec - ticket->queuedAt.tv_sec == matchWaitSeconds && now.tv_nsec >= ticket->queuedAt.tv_nsec);
+}
+
+//return 0 if nobody is queued, the deadline is in CLOCK_REALTIME for sem_timedwait()
+static int getWaitDeadline(struct timespec *deadline) {
+    if (queue.head == NULL) {
+        return 0;
+    }
+    // The queued sockets are not watched, so the logins that have left are looked for regularly
+    long waitNanoseconds = MATCH_SWEEP_INTERVAL_SECONDS * 1000000000L;
+    if (!hasWaitedLongEnough(queue.head)) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long oldestNanoseconds = (queue.head->queuedAt.tv_sec + matchWaitSeconds - now.tv_sec) * 1000000000L
+                                 + (queue.head->queuedAt.tv_nsec - now.tv_nsec);
+        if (oldestNanoseconds < waitNanoseconds) {
+            waitNanoseconds = oldestNanoseconds;
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += waitNanoseconds / 1000000000L;
+    deadline->tv_nsec += waitNanoseconds % 1000000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+    return 1;
+}
@@ -0,0 +1,37 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * matchmaker.h: Header für das Matchmaking
+ *
+ * Mit Matchmaking kommen angemeldete Clients nicht in den offenen Raum,
+ * sondern in eine Warteschlange. Der Matchmaker-Thread bildet daraus Gruppen,
+ * sobald ein Raum voll wird oder der älteste Client lange genug gewartet hat,
+ * und übergibt jede Gruppe dem Login, der einen neuen Raum für sie eröffnet.
+ */
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+
+#include <time.h>
+#include "rfc.h"
+
+typedef struct match_ticket {
+    struct match_ticket *next; // The ticket queued after this one, or the next one of the group
+    int clientSocket;
+    struct timespec queuedAt; // CLOCK_MONOTONIC
+    MESSAGE loginRequest;
+} MATCH_TICKET;
+
+int startMatchmaker(int groupSize, int waitSeconds, void (*startMatch)(MATCH_TICKET *group, int playerCount));
+
+int isMatchmakingEnabled();
+
+int enqueueLogin(int clientSocket, const MESSAGE *loginRequest);
+
+int getQueuedLoginCount();
+
+void retireMatchmaker(void (*handOffLogin)(int clientSocket, MESSAGE *loginRequest));
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * mpscqueue.c: Implementierung der Warteschlangen mit vielen Erzeugern und einem Verbraucher
+ *
+ * Nach dem Verfahren von Dmitry Vyukov: Ein Erzeuger tauscht den Kopf aus und
+ * verkettet danach den alten Kopf mit seinem Eintrag. Der Verbraucher gibt
+ * einen Eintrag erst heraus, wenn er einen Nachfolger hat; für den letzten
+ * hängt er dazu den Stub wieder an.
+ */
+#include <stddef.h>
+#include "mpscqueue.h"
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+void initMpscQueue(MPSC_QUEUE *queue) {
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+//Can be called from any thread
+void pushMpscQueue(MPSC_QUEUE *queue, MPSC_NODE *node) {
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    MPSC_NODE *previous = __atomic_exchange_n(&queue->head, node, __ATOMIC_SEQ_CST);
+    // Until this store the consumer cannot reach the node
+    __atomic_store_n(&previous->next, node, __ATOMIC_RELEASE);
+}
+
+//Only for the consumer, return NULL if the queue is empty or a push is not finished yet
+MPSC_NODE *popMpscQueue(MPSC_QUEUE *queue) {
+    MPSC_NODE *tail = queue->tail;
+    MPSC_NODE *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &queue->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    // The tail is the last node, it may only be taken with a successor behind it
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST)) {
+        return NULL;
+    }
+    pushMpscQueue(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+//Only for the consumer, a push that is not finished yet counts as not empty
+int isMpscQueueEmpty(MPSC_QUEUE *queue) {
+    return queue->tail == &queue->stub && __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST) == &queue->stub;
+}
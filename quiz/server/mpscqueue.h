@@ -0,0 +1,35 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * mpscqueue.h: Header für Warteschlangen mit vielen Erzeugern und einem Verbraucher
+ *
+ * Die Warteschlange ist intrusiv und kommt ohne Lock aus: Jeder Eintrag
+ * beginnt mit einem MPSC_NODE, Erzeuger hängen ihn mit einem atomaren Tausch
+ * an. Nur ein Thread darf entnehmen. Solange ein Erzeuger seinen Eintrag noch
+ * nicht verkettet hat, liefert popMpscQueue() NULL, obwohl sie nicht leer ist.
+ */
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+typedef struct mpsc_node {
+    struct mpsc_node *next;
+} MPSC_NODE;
+
+typedef struct {
+    MPSC_NODE *head; // The newest node, producers swap it
+    MPSC_NODE *tail; // The oldest node, only the consumer moves it
+    MPSC_NODE stub; // Keeps the queue linked while it is empty
+} MPSC_QUEUE;
+
+void initMpscQueue(MPSC_QUEUE *queue);
+
+void pushMpscQueue(MPSC_QUEUE *queue, MPSC_NODE *node);
+
+/* nullable */ MPSC_NODE *popMpscQueue(MPSC_QUEUE *queue);
+
+int isMpscQueueEmpty(MPSC_QUEUE *queue);
+
+#endif
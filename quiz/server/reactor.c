@@ -0,0 +1,800 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * reactor.c: Implementierung der Event-Loops der Client-Sockets
+ *
+ * Anstatt pro Client einen eigenen Thread zu starten, läuft pro CPU-Kern ein
+ * Reactor-Thread mit einer eigenen Event-Loop. Jeder Reactor besitzt einen eigenen
+ * Listen-Socket (SO_REUSEPORT, siehe login.c), nimmt darauf selbst Verbindungen an
+ * und behandelt danach alle Sockets, die er angenommen hat. Solange der Login eines
+ * Sockets nicht abgeschlossen ist, meldet der Reactor nur, dass Daten bereitstehen
+ * (siehe login.c), danach empfängt er die Nachrichten selbst. Dabei wird pro Ereignis
+ * mit einem Systemaufruf alles gelesen, was vorhanden ist (siehe receivebuffer.c).
+ * Die Client-Sockets sind nicht blockierend. Was nicht sofort gesendet werden kann,
+ * wird in die Sendewarteschlange der Verbindung gestellt (siehe sendqueue.c) und
+ * gesendet, sobald epoll meldet, dass der Socket wieder schreibbar ist. Der Kernel verteilt die
+ * neuen Verbindungen auf die Listen-Sockets, die Reactoren teilen sich also beim
+ * Annehmen und Empfangen keine Daten.
+ * Lokale Clients können ihre Nachrichten stattdessen über gemeinsamen Speicher
+ * austauschen (siehe shmtransport.c), ihr Socket meldet dann nur, dass ein Ring
+ * Daten oder wieder Platz hat.
+ * Als Event-Loop wird epoll verwendet. Alternativ kann beim Start das io_uring-Backend
+ * (siehe uring.c) gewählt werden, an das dann alle Aufrufe weitergeleitet werden.
+ */
+#define _GNU_SOURCE // accept4()
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "../common/util.h"
+#include "reactor.h"
+#include "rfc.h"
+#include "threadholder.h"
+#include "uring.h"
+#include "receivebuffer.h"
+#include "sendqueue.h"
+#include "mutexhelper.h"
+#include "shmtransport.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+#define REACTOR_EVENTS_PER_WAIT 64
+#define REACTOR_ACCEPTS_PER_EVENT 64
+#define REACTOR_CLIENT_EVENTS (EPOLLIN | EPOLLRDHUP)
+#define REACTOR_NO_USER_ID (-1) // A removed client, its connection is kept for the next one on the descriptor
+#define REACTOR_LISTENER_ID (-2)
+#define REACTOR_HANDSHAKE_ID (-3)
+#define REACTOR_WAKEUP_ID (-4)
+#define REACTOR_MAX_SOCKETS (1 << 20)
+#define REACTOR_DRAIN_TIMEOUT_MILLIS 1000
+
+typedef struct release_request {
+    int clientSocket;
+    int userId;
+    struct release_request *next;
+} RELEASE_REQUEST;
+
+typedef struct {
+    int index;
+    int epollFileDescriptor;
+    int wakeupFileDescriptor;
+    pthread_mutex_t releaseMutex;
+    RELEASE_REQUEST *releases;
+    pthread_t threadId;
+} REACTOR;
+
+typedef struct {
+    int userId;
+    RECEIVE_BUFFER received;
+    pthread_mutex_t sendMutex;
+    SEND_QUEUE sendQueue;
+    int writeWatched;
+    int releasing;
+} CONNECTION;
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static void *reactorThread(void *reactorPtr);
+
+static void epollLoop(REACTOR *reactor);
+
+static void acceptConnections(int listenSocket);
+
+static void releaseClients(REACTOR *reactor);
+
+static void releaseClient(REACTOR *reactor, int clientSocket, int userId);
+
+static void finishRelease(int clientSocket, int userId, RECEIVE_BUFFER *received, SEND_QUEUE *unsent);
+
+static int handleAdoptedMessages(int clientSocket, int userId, RECEIVE_BUFFER *received);
+
+static void handleClientEvent(int clientSocket, int userId);
+
+static int receiveSharedMemory(int clientSocket, SHM_CHANNEL *channel);
+
+static void handleReceivedMessages(int clientSocket, int userId);
+
+static void flushConnection(int clientSocket);
+
+static int watchConnection(int clientSocket, CONNECTION *connection, int writable);
+
+static int assignSocketReactor(int clientSocket);
+
+static int getSocketReactor(int clientSocket);
+
+static uint64_t packEventData(int clientSocket, int userId);
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static int reactorBackend = REACTOR_BACKEND_EPOLL;
+
+static REACTOR *reactors = NULL;
+static int reactorCount = 0;
+
+// Maps every socket to the reactor that owns it (-1 if none)
+static int *socketReactors = NULL;
+static int socketReactorCapacity = 0;
+
+// Connections of the epoll backend by socket, allocated on first use and reused for later sockets
+static CONNECTION **connections = NULL;
+
+// Shared memory of local clients by socket, NULL for all other sockets
+static SHM_CHANNEL **sharedMemoryChannels = NULL;
+
+// Index of the reactor running in the current thread (-1 for all other threads)
+static __thread int currentReactorIndex = -1;
+
+static unsigned int nextForeignReactor = 0;
+
+static REACTOR_MESSAGE_CALLBACK onMessage = NULL;
+
+static REACTOR_DISCONNECT_CALLBACK onDisconnect = NULL;
+
+static REACTOR_HANDSHAKE_CALLBACK onHandshake = NULL;
+
+static REACTOR_ACCEPT_CALLBACK onAccept = NULL;
+
+static REACTOR_RELEASE_CALLBACK onRelease = NULL;
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+int startReactors(int backend, int count, int slowConsumerPolicy, REACTOR_MESSAGE_CALLBACK messageCallback,
+                  REACTOR_DISCONNECT_CALLBACK disconnectCallback) {
+    reactorBackend = backend;
+    reactorCount = count;
+    onMessage = messageCallback;
+    onDisconnect = disconnectCallback;
+    setSlowConsumerPolicy(slowConsumerPolicy);
+
+    // Sockets are looked up by their descriptor, so we need a slot for every possible descriptor
+    struct rlimit fileLimit;
+    if (getrlimit(RLIMIT_NOFILE, &fileLimit) < 0) {
+        errnoPrint("Could not get the file descriptor limit");
+        return -1;
+    }
+    socketReactorCapacity = fileLimit.rlim_cur < REACTOR_MAX_SOCKETS
+                            ? (int) fileLimit.rlim_cur
+                            : REACTOR_MAX_SOCKETS;
+    socketReactors = malloc(socketReactorCapacity * sizeof(int));
+    connections = calloc((size_t) socketReactorCapacity, sizeof(CONNECTION *));
+    sharedMemoryChannels = calloc((size_t) socketReactorCapacity, sizeof(SHM_CHANNEL *));
+    reactors = calloc((size_t) reactorCount, sizeof(REACTOR));
+    if (socketReactors == NULL || connections == NULL || sharedMemoryChannels == NULL || reactors == NULL) {
+        errorPrint("Could not allocate reactors!");
+        return -2;
+    }
+    for (int i = 0; i < socketReactorCapacity; i++) {
+        socketReactors[i] = -1;
+    }
+
+    if (reactorBackend == REACTOR_BACKEND_IO_URING
+        && initUringReactors(reactorCount, messageCallback, disconnectCallback) < 0) {
+        errorPrint("Could not initialize the io_uring reactors!");
+        return -3;
+    }
+
+    for (int i = 0; i < reactorCount; i++) {
+        REACTOR *reactor = &reactors[i];
+        reactor->index = i;
+        if (reactorBackend == REACTOR_BACKEND_EPOLL) {
+            reactor->epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+            if (reactor->epollFileDescriptor < 0) {
+                errnoPrint("Could not create epoll instance");
+                return -4;
+            }
+
+            // Other threads wake the reactor up to let it release sockets it is receiving on
+            reactor->wakeupFileDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = packEventData(reactor->wakeupFileDescriptor, REACTOR_WAKEUP_ID);
+            if (reactor->wakeupFileDescriptor < 0 || mutexInit(&reactor->releaseMutex, NULL) < 0
+                || epoll_ctl(reactor->epollFileDescriptor, EPOLL_CTL_ADD, reactor->wakeupFileDescriptor, &event) < 0) {
+                errnoPrint("Could not create reactor wakeup");
+                return -4;
+            }
+        }
+
+        if (pthread_create(&reactor->threadId, NULL, reactorThread, reactor) != 0) {
+            errorPrint("Can't create reactor thread %d!", i);
+            return -5;
+        }
+        registerThread(reactor->threadId);
+    }
+
+    infoPrint("Started %d reactors with %s backend", reactorCount,
+              reactorBackend == REACTOR_BACKEND_IO_URING ? "io_uring" : "epoll");
+    return 0;
+}
+
+int getReactorCount() {
+    return reactorCount;
+}
+
+//A reactor may watch several listen sockets, all of them use the same callback
+int reactorAddListener(int reactorIndex, int listenSocket, REACTOR_ACCEPT_CALLBACK acceptCallback) {
+    REACTOR *reactor = &reactors[reactorIndex];
+    onAccept = acceptCallback;
+
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        return uringAddListener(reactorIndex, listenSocket, acceptCallback);
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = packEventData(listenSocket, REACTOR_LISTENER_ID);
+    if (epoll_ctl(reactor->epollFileDescriptor, EPOLL_CTL_ADD, listenSocket, &event) < 0) {
+        errnoPrint("Could not add listen socket to epoll");
+        return -1;
+    }
+    return 0;
+}
+
+//The reactors stop accepting on the socket, it stays open
+int reactorRemoveListener(int listenSocket) {
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        return uringRemoveListener(listenSocket);
+    }
+
+    // Listen sockets are not mapped to their reactor, so all of them are asked
+    int removed = 0;
+    for (int i = 0; i < reactorCount; i++) {
+        if (epoll_ctl(reactors[i].epollFileDescriptor, EPOLL_CTL_DEL, listenSocket, NULL) == 0) {
+            removed = 1;
+        }
+    }
+    return removed ? 0 : -1;
+}
+
+int reactorAddHandshake(int clientSocket, REACTOR_HANDSHAKE_CALLBACK handshakeCallback) {
+    int reactorIndex = assignSocketReactor(clientSocket);
+    if (reactorIndex < 0) {
+        return -1;
+    }
+    onHandshake = handshakeCallback;
+
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        return uringAddHandshake(reactorIndex, clientSocket, handshakeCallback);
+    }
+
+    struct epoll_event event;
+    event.events = REACTOR_CLIENT_EVENTS;
+    event.data.u64 = packEventData(clientSocket, REACTOR_HANDSHAKE_ID);
+    if (epoll_ctl(reactors[reactorIndex].epollFileDescriptor, EPOLL_CTL_ADD, clientSocket, &event) < 0) {
+        errnoPrint("Could not add handshake socket to epoll");
+        return -2;
+    }
+    return 0;
+}
+
+int reactorRemoveHandshake(int clientSocket) {
+    int reactorIndex = getSocketReactor(clientSocket);
+    if (reactorIndex < 0) {
+        debugPrint("Handshake socket %d was not watched by a reactor (anymore)", clientSocket);
+        return -1;
+    }
+    __atomic_store_n(&socketReactors[clientSocket], -1, __ATOMIC_RELEASE);
+
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        return uringRemoveHandshake(reactorIndex, clientSocket);
+    }
+
+    if (epoll_ctl(reactors[reactorIndex].epollFileDescriptor, EPOLL_CTL_DEL, clientSocket, NULL) < 0) {
+        debugPrint("Handshake socket %d was not watched by reactor %d (anymore)", clientSocket, reactorIndex);
+        return -2;
+    }
+    return 0;
+}
+
+//A socket taken over from another owner brings what it has received already
+int reactorAddClient(int clientSocket, int userId, /* nullable */ RECEIVE_BUFFER *received) {
+    if (received != NULL && handleAdoptedMessages(clientSocket, userId, received) < 0) {
+        return -4;
+    }
+
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        int reactorIndex = assignSocketReactor(clientSocket);
+        return reactorIndex < 0 ? -1 : uringAddClient(reactorIndex, clientSocket, userId, received);
+    }
+
+    // A client that does not read must never block a sender, its messages are queued instead
+    int socketFlags = fcntl(clientSocket, F_GETFL);
+    if (socketFlags < 0 || fcntl(clientSocket, F_SETFL, socketFlags | O_NONBLOCK) < 0) {
+        errnoPrint("Could not make client socket non-blocking");
+        return -1;
+    }
+
+    if (clientSocket >= 0 && clientSocket < socketReactorCapacity && connections[clientSocket] == NULL) {
+        CONNECTION *connection = malloc(sizeof(CONNECTION));
+        if (connection == NULL || mutexInit(&connection->sendMutex, NULL) < 0) {
+            errorPrint("Could not allocate connection for socket %d!", clientSocket);
+            free(connection);
+            return -3;
+        }
+        initSendQueue(&connection->sendQueue);
+        connections[clientSocket] = connection;
+    }
+    int reactorIndex = assignSocketReactor(clientSocket);
+    if (reactorIndex < 0) {
+        return -1;
+    }
+    CONNECTION *connection = connections[clientSocket];
+    connection->userId = userId;
+    connection->writeWatched = 0;
+    connection->releasing = 0;
+    if (received != NULL) {
+        connection->received = *received;
+    } else {
+        initReceiveBuffer(&connection->received);
+    }
+
+    struct epoll_event event;
+    event.events = REACTOR_CLIENT_EVENTS;
+    event.data.u64 = packEventData(clientSocket, userId);
+    if (epoll_ctl(reactors[reactorIndex].epollFileDescriptor, EPOLL_CTL_ADD, clientSocket, &event) < 0) {
+        errnoPrint("Could not add client socket to epoll");
+        return -2;
+    }
+
+    debugPrint("Reactor %d watches socket %d of user %d", reactorIndex, clientSocket, userId);
+    return 0;
+}
+
+int reactorRemoveClient(int clientSocket) {
+    int reactorIndex = getSocketReactor(clientSocket);
+    if (reactorIndex < 0) {
+        debugPrint("Socket %d was not watched by a reactor (anymore)", clientSocket);
+        reactorDetachChannel(clientSocket);
+        return -1;
+    }
+    __atomic_store_n(&socketReactors[clientSocket], -1, __ATOMIC_RELEASE);
+
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        return uringRemoveClient(reactorIndex, clientSocket);
+    }
+
+    // Messages that are still queued will never be sent
+    CONNECTION *connection = connections[clientSocket];
+    mutexLock(&connection->sendMutex);
+    connection->userId = REACTOR_NO_USER_ID;
+    clearSendQueue(&connection->sendQueue);
+    // Senders look at the channel while holding the mutex, so it is unmapped under the mutex as well
+    reactorDetachChannel(clientSocket);
+    mutexUnlock(&connection->sendMutex);
+
+    if (epoll_ctl(reactors[reactorIndex].epollFileDescriptor, EPOLL_CTL_DEL, clientSocket, NULL) < 0) {
+        debugPrint("Socket %d was not watched by reactor %d (anymore)", clientSocket, reactorIndex);
+        return -2;
+    }
+    return 0;
+}
+
+//The reactor stops handling the socket and passes it to the callback, see REACTOR_RELEASE_CALLBACK
+int reactorReleaseClient(int clientSocket, REACTOR_RELEASE_CALLBACK releaseCallback) {
+    int reactorIndex = getSocketReactor(clientSocket);
+    if (reactorIndex < 0) {
+        return -1;
+    } else if (__atomic_load_n(&sharedMemoryChannels[clientSocket], __ATOMIC_ACQUIRE) != NULL) {
+        // The mapping of the channel cannot be passed on with the socket
+        return -2;
+    }
+    onRelease = releaseCallback;
+
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        return uringReleaseClient(reactorIndex, clientSocket, finishRelease);
+    }
+
+    // Only the reactor itself knows when it is not receiving on the socket, so it is asked to do the release
+    RELEASE_REQUEST *request = malloc(sizeof(RELEASE_REQUEST));
+    if (request == NULL) {
+        errorPrint("Could not allocate release of socket %d!", clientSocket);
+        return -3;
+    }
+    REACTOR *reactor = &reactors[reactorIndex];
+    request->clientSocket = clientSocket;
+    request->userId = connections[clientSocket]->userId;
+    mutexLock(&reactor->releaseMutex);
+    request->next = reactor->releases;
+    reactor->releases = request;
+    mutexUnlock(&reactor->releaseMutex);
+
+    uint64_t wakeup = 1;
+    if (write(reactor->wakeupFileDescriptor, &wakeup, sizeof(wakeup)) < 0) {
+        errnoPrint("Could not wake up reactor");
+        return -4;
+    }
+    return 0;
+}
+
+//The messages of the socket are exchanged over the shared memory from now on (epoll backend only)
+int reactorAttachChannel(int clientSocket, SHM_CHANNEL *channel) {
+    if (reactorBackend != REACTOR_BACKEND_EPOLL || clientSocket < 0 || clientSocket >= socketReactorCapacity) {
+        return -1;
+    }
+    __atomic_store_n(&sharedMemoryChannels[clientSocket], channel, __ATOMIC_RELEASE);
+    return 0;
+}
+
+//Has to be called before the socket is closed, so the descriptor can be reused
+void reactorDetachChannel(int clientSocket) {
+    if (clientSocket < 0 || clientSocket >= socketReactorCapacity || sharedMemoryChannels == NULL) {
+        return;
+    }
+    unmapSharedMemoryChannel(__atomic_exchange_n(&sharedMemoryChannels[clientSocket], NULL, __ATOMIC_ACQ_REL));
+}
+
+ssize_t reactorSend(int clientSocket, WIRE_FRAME *wire) {
+    int reactorIndex = getSocketReactor(clientSocket);
+    if (reactorIndex >= 0 && reactorBackend == REACTOR_BACKEND_IO_URING) {
+        return uringSend(reactorIndex, clientSocket, wire);
+    }
+
+    SHM_CHANNEL *channel = clientSocket >= 0 && clientSocket < socketReactorCapacity
+                           ? __atomic_load_n(&sharedMemoryChannels[clientSocket], __ATOMIC_ACQUIRE)
+                           : NULL;
+    CONNECTION *connection = reactorIndex >= 0 ? connections[clientSocket] : NULL;
+    if (connection != NULL) {
+        mutexLock(&connection->sendMutex);
+        if (connection->userId == REACTOR_NO_USER_ID) {
+            // The connection is left from a removed client, the descriptor is in a login now
+            mutexUnlock(&connection->sendMutex);
+            connection = NULL;
+        }
+    }
+    if (connection == NULL) {
+        // Sockets in the login are not handled by a reactor yet, their rings are still empty
+        if (channel != NULL) {
+            return writeSharedMemoryRing(&channel->toClient, wire->data, wire->length, clientSocket)
+                   ? (ssize_t) wire->length
+                   : -1;
+        }
+        return send(clientSocket, wire->data, wire->length, MSG_NOSIGNAL);
+    }
+
+    // Look again, the channel may have been detached while waiting for the mutex
+    channel = sharedMemoryChannels[clientSocket];
+
+    // Send directly as long as nothing is queued, otherwise the order would get mixed up
+    ssize_t sendSize = 0;
+    if (channel != NULL && isSendQueueEmpty(&connection->sendQueue)
+        && writeSharedMemoryRing(&channel->toClient, wire->data, wire->length, clientSocket)) {
+        mutexUnlock(&connection->sendMutex);
+        return (ssize_t) wire->length;
+    } else if (channel == NULL && isSendQueueEmpty(&connection->sendQueue) && !connection->releasing) {
+        sendSize = send(clientSocket, wire->data, wire->length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sendSize == (ssize_t) wire->length) {
+            mutexUnlock(&connection->sendMutex);
+            return sendSize;
+        } else if (sendSize < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            mutexUnlock(&connection->sendMutex);
+            return -1;
+        } else if (sendSize < 0) {
+            sendSize = 0;
+        }
+    }
+
+    // The queue only keeps a reference, the frame is shared with all other receivers
+    SEND_FRAME *frame = createSendFrame(wire, (size_t) sendSize);
+    if (frame == NULL) {
+        mutexUnlock(&connection->sendMutex);
+        errorPrint("Could not allocate send frame for socket %d!", clientSocket);
+        return -1;
+    }
+    if (enqueueSendFrame(&connection->sendQueue, frame, 0) < 0) {
+        // The reactor notices the shutdown and disconnects the client as usual
+        mutexUnlock(&connection->sendMutex);
+        errorPrint("Client on socket %d is too slow, disconnecting", clientSocket);
+        shutdown(clientSocket, SHUT_RDWR);
+        return -1;
+    }
+    // A local client rings when it has made space in its ring, a released socket is not watched anymore
+    if (channel == NULL && !connection->writeWatched && !connection->releasing) {
+        watchConnection(clientSocket, connection, 1);
+    }
+    mutexUnlock(&connection->sendMutex);
+
+    return (ssize_t) wire->length;
+}
+
+void drainReactor() {
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        uringDrain();
+        return;
+    }
+
+    // Give the queued messages of the epoll backend some time to be sent
+    for (int waited = 0; waited < REACTOR_DRAIN_TIMEOUT_MILLIS; waited += 10) {
+        size_t bytesLeft = 0;
+        for (int i = 0; i < socketReactorCapacity; i++) {
+            CONNECTION *connection = connections[i];
+            if (connection == NULL || getSocketReactor(i) < 0) {
+                continue;
+            }
+            mutexLock(&connection->sendMutex);
+            SHM_CHANNEL *channel = sharedMemoryChannels[i];
+            ssize_t queued = channel != NULL
+                             ? flushSharedMemoryQueue(channel, &connection->sendQueue, i)
+                             : flushSendQueue(&connection->sendQueue, i);
+            mutexUnlock(&connection->sendMutex);
+            bytesLeft += queued > 0 ? (size_t) queued : 0;
+        }
+        if (bytesLeft == 0) {
+            return;
+        }
+        usleep(10 * 1000);
+    }
+    errorPrint("Reactor could not send all messages before shutdown!");
+}
+
+static void *reactorThread(void *reactorPtr) {
+    REACTOR *reactor = reactorPtr;
+    currentReactorIndex = reactor->index;
+
+    if (reactorBackend == REACTOR_BACKEND_IO_URING) {
+        runUringReactor(reactor->index);
+    } else {
+        epollLoop(reactor);
+    }
+    return NULL;
+}
+
+static void epollLoop(REACTOR *reactor) {
+    struct epoll_event events[REACTOR_EVENTS_PER_WAIT];
+
+    while (1) {
+        int eventCount = epoll_wait(reactor->epollFileDescriptor, events, REACTOR_EVENTS_PER_WAIT, -1);
+        if (eventCount < 0) {
+            // Signals may interrupt the wait, so just wait again
+            if (errno == EINTR) {
+                continue;
+            }
+            errnoPrint("Reactor could not wait for events");
+            return;
+        }
+
+        for (int i = 0; i < eventCount; i++) {
+            int socket = (int) (events[i].data.u64 & 0xFFFFFFFF);
+            int userId = (int) (events[i].data.u64 >> 32);
+            if (userId == REACTOR_LISTENER_ID) {
+                acceptConnections(socket);
+            } else if (userId == REACTOR_WAKEUP_ID) {
+                releaseClients(reactor);
+            } else if (userId == REACTOR_HANDSHAKE_ID) {
+                // The socket stays registered until the login removes it, so the result is not needed
+                onHandshake(socket);
+            } else if (getSocketReactor(socket) == reactor->index) {
+                // Sockets released or removed by an earlier event of this round are skipped
+                if (events[i].events & EPOLLOUT) {
+                    flushConnection(socket);
+                }
+                if (events[i].events & ~EPOLLOUT) {
+                    handleClientEvent(socket, userId);
+                }
+            }
+        }
+    }
+}
+
+static void acceptConnections(int listenSocket) {
+    // The listen socket is non-blocking, so take the pending connections in one batch.
+    // The batch is limited, so a connection storm does not starve the clients of this reactor,
+    // the listen socket stays readable for the rest.
+    for (int i = 0; i < REACTOR_ACCEPTS_PER_EVENT; i++) {
+        int clientSocket = accept4(listenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                errnoPrint("Could not accept client connection");
+            }
+            return;
+        }
+        onAccept(clientSocket);
+    }
+}
+
+static void releaseClients(REACTOR *reactor) {
+    uint64_t wakeups;
+    if (read(reactor->wakeupFileDescriptor, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN) {
+        errnoPrint("Could not read reactor wakeup");
+    }
+
+    mutexLock(&reactor->releaseMutex);
+    RELEASE_REQUEST *request = reactor->releases;
+    reactor->releases = NULL;
+    mutexUnlock(&reactor->releaseMutex);
+
+    while (request != NULL) {
+        RELEASE_REQUEST *next = request->next;
+        releaseClient(reactor, request->clientSocket, request->userId);
+        free(request);
+        request = next;
+    }
+}
+
+static void releaseClient(REACTOR *reactor, int clientSocket, int userId) {
+    CONNECTION *connection = connections[clientSocket];
+    if (getSocketReactor(clientSocket) != reactor->index || connection == NULL || connection->userId != userId) {
+        // The client has disconnected in the meantime, the descriptor may even belong to someone else now
+        return;
+    }
+    if (epoll_ctl(reactor->epollFileDescriptor, EPOLL_CTL_DEL, clientSocket, NULL) < 0) {
+        debugPrint("Socket %d was not watched by reactor %d (anymore)", clientSocket, reactor->index);
+    }
+
+    // The reactor does not receive on the socket anymore, so the buffer is complete
+    mutexLock(&connection->sendMutex);
+    connection->releasing = 1;
+    mutexUnlock(&connection->sendMutex);
+
+    finishRelease(clientSocket, connection->userId, &connection->received, &connection->sendQueue);
+
+    mutexLock(&connection->sendMutex);
+    connection->releasing = 0;
+    clearSendQueue(&connection->sendQueue);
+    mutexUnlock(&connection->sendMutex);
+    close(clientSocket);
+}
+
+//Hands the socket to the release callback, the descriptor is closed by the backend afterwards
+static void finishRelease(int clientSocket, int userId, RECEIVE_BUFFER *received, SEND_QUEUE *unsent) {
+    onRelease(clientSocket, userId, received, unsent);
+    __atomic_store_n(&socketReactors[clientSocket], -1, __ATOMIC_RELEASE);
+}
+
+//return -1 if one of the messages is malformed
+static int handleAdoptedMessages(int clientSocket, int userId, RECEIVE_BUFFER *received) {
+    // The socket is not watched yet, so nothing else is handled for the user in the meantime
+    MESSAGE message;
+    ssize_t messageSize;
+    while ((messageSize = nextReceivedMessage(received, &message)) > 0) {
+        onMessage(userId, &message);
+    }
+    if (messageSize < 0) {
+        errorPrint("Received malformed message on adopted socket %d!", clientSocket);
+        return -1;
+    }
+    return 0;
+}
+
+static void handleClientEvent(int clientSocket, int userId) {
+    SHM_CHANNEL *channel = __atomic_load_n(&sharedMemoryChannels[clientSocket], __ATOMIC_ACQUIRE);
+    if (channel != NULL) {
+        if (receiveSharedMemory(clientSocket, channel) < 0) {
+            onDisconnect(userId);
+        }
+        return;
+    }
+
+    RECEIVE_BUFFER *buffer = &connections[clientSocket]->received;
+    ssize_t readSize = fillReceiveBuffer(buffer, clientSocket);
+    if (readSize < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        debugPrint("Receiving on socket %d was interrupted", clientSocket);
+        return;
+    } else if (readSize <= 0) {
+        // The disconnect callback removes and closes the socket
+        onDisconnect(userId);
+        return;
+    }
+
+    handleReceivedMessages(clientSocket, userId);
+}
+
+//return -1 if the client is gone
+static int receiveSharedMemory(int clientSocket, SHM_CHANNEL *channel) {
+    // The doorbell tells that the client wrote to its ring or made space in ours
+    if (drainSharedMemoryDoorbell(clientSocket) < 0) {
+        return -1;
+    }
+    flushConnection(clientSocket);
+
+    // The ring is copied in chunks that fit the receive buffer, after each chunk the messages are handled
+    RECEIVE_BUFFER *buffer = &connections[clientSocket]->received;
+    int reactorIndex = currentReactorIndex;
+    char chunk[RECEIVE_BUFFER_SIZE];
+    while (getSocketReactor(clientSocket) == reactorIndex) {
+        size_t space = RECEIVE_BUFFER_SIZE - (buffer->tail - buffer->head);
+        size_t readSize = readSharedMemoryRing(&channel->toServer, chunk, space, clientSocket);
+        if (readSize == 0) {
+            break;
+        }
+        appendReceiveBuffer(buffer, chunk, readSize);
+        handleReceivedMessages(clientSocket, connections[clientSocket]->userId);
+    }
+    return 0;
+}
+
+static void handleReceivedMessages(int clientSocket, int userId) {
+    // Hand over every complete message, a partial one stays in the buffer for the next event
+    RECEIVE_BUFFER *buffer = &connections[clientSocket]->received;
+    int reactorIndex = currentReactorIndex;
+    while (getSocketReactor(clientSocket) == reactorIndex) {
+        MESSAGE message;
+        ssize_t messageSize = nextReceivedMessage(buffer, &message);
+        if (messageSize == 0) {
+            return;
+        } else if (messageSize < 0) {
+            errorPrint("Received malformed message on socket %d!", clientSocket);
+            onDisconnect(userId);
+            return;
+        }
+        onMessage(userId, &message);
+    }
+}
+
+static void flushConnection(int clientSocket) {
+    CONNECTION *connection = connections[clientSocket];
+    mutexLock(&connection->sendMutex);
+    if (getSocketReactor(clientSocket) != currentReactorIndex) {
+        mutexUnlock(&connection->sendMutex);
+        return;
+    }
+
+    SHM_CHANNEL *channel = sharedMemoryChannels[clientSocket];
+    ssize_t bytesLeft = channel != NULL
+                        ? flushSharedMemoryQueue(channel, &connection->sendQueue, clientSocket)
+                        : flushSendQueue(&connection->sendQueue, clientSocket);
+    if (bytesLeft < 0) {
+        // The reactor notices the shutdown and disconnects the client as usual
+        clearSendQueue(&connection->sendQueue);
+        shutdown(clientSocket, SHUT_RDWR);
+    }
+    if (bytesLeft <= 0 && connection->writeWatched) {
+        watchConnection(clientSocket, connection, 0);
+    }
+    mutexUnlock(&connection->sendMutex);
+}
+
+//The send mutex of the connection has to be locked
+static int watchConnection(int clientSocket, CONNECTION *connection, int writable) {
+    if (connection->userId == REACTOR_NO_USER_ID) {
+        return -1;
+    }
+    struct epoll_event event;
+    event.events = writable ? REACTOR_CLIENT_EVENTS | EPOLLOUT : REACTOR_CLIENT_EVENTS;
+    event.data.u64 = packEventData(clientSocket, connection->userId);
+    int reactorIndex = getSocketReactor(clientSocket);
+    if (reactorIndex < 0 || epoll_ctl(reactors[reactorIndex].epollFileDescriptor, EPOLL_CTL_MOD, clientSocket,
+                                      &event) < 0) {
+        return -1;
+    }
+    connection->writeWatched = writable;
+    return 0;
+}
+
+static int assignSocketReactor(int clientSocket) {
+    if (clientSocket < 0 || clientSocket >= socketReactorCapacity) {
+        errorPrint("Socket %d exceeds the reactor socket table!", clientSocket);
+        return -1;
+    }
+
+    // Sockets stay on the reactor that accepted them, others are spread over all reactors
+    int reactorIndex = currentReactorIndex;
+    if (reactorIndex < 0) {
+        reactorIndex = (int) (__atomic_fetch_add(&nextForeignReactor, 1, __ATOMIC_RELAXED) % reactorCount);
+    }
+    __atomic_store_n(&socketReactors[clientSocket], reactorIndex, __ATOMIC_RELEASE);
+    return reactorIndex;
+}
+
+static int getSocketReactor(int clientSocket) {
+    if (clientSocket < 0 || clientSocket >= socketReactorCapacity) {
+        return -1;
+    }
+    return __atomic_load_n(&socketReactors[clientSocket], __ATOMIC_ACQUIRE);
+}
+
+static uint64_t packEventData(int clientSocket, int userId) {
+    return ((uint64_t) (uint32_t) userId << 32) | (uint32_t) clientSocket;
+}
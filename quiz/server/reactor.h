@@ -0,0 +1,64 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * reactor.h: Header für die Event-Loops der Client-Sockets
+ */
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <sys/types.h>
+#include "rfc.h"
+#include "receivebuffer.h"
+#include "sendqueue.h"
+#include "shmtransport.h"
+
+enum {
+    REACTOR_BACKEND_EPOLL = 1,
+    REACTOR_BACKEND_IO_URING = 2
+};
+
+typedef void (*REACTOR_ACCEPT_CALLBACK)(int clientSocket);
+
+// Returns > 0 if the socket shall still be watched for its handshake
+typedef int (*REACTOR_HANDSHAKE_CALLBACK)(int clientSocket);
+
+typedef void (*REACTOR_MESSAGE_CALLBACK)(int userId, MESSAGE *message);
+
+typedef void (*REACTOR_DISCONNECT_CALLBACK)(int userId);
+
+// Takes over a released socket together with what was received but not handled and what was not sent yet.
+// Until it returns, messages to the socket are only queued. The reactor closes its descriptor afterwards.
+typedef void (*REACTOR_RELEASE_CALLBACK)(int clientSocket, int userId, RECEIVE_BUFFER *received,
+                                         SEND_QUEUE *unsent);
+
+int startReactors(int backend, int reactorCount, int slowConsumerPolicy, REACTOR_MESSAGE_CALLBACK messageCallback,
+                  REACTOR_DISCONNECT_CALLBACK disconnectCallback);
+
+int getReactorCount();
+
+int reactorAddListener(int reactorIndex, int listenSocket, REACTOR_ACCEPT_CALLBACK acceptCallback);
+
+int reactorRemoveListener(int listenSocket);
+
+int reactorAddHandshake(int clientSocket, REACTOR_HANDSHAKE_CALLBACK handshakeCallback);
+
+int reactorRemoveHandshake(int clientSocket);
+
+int reactorAddClient(int clientSocket, int userId, /* nullable */ RECEIVE_BUFFER *received);
+
+int reactorRemoveClient(int clientSocket);
+
+int reactorReleaseClient(int clientSocket, REACTOR_RELEASE_CALLBACK releaseCallback);
+
+int reactorAttachChannel(int clientSocket, SHM_CHANNEL *channel);
+
+void reactorDetachChannel(int clientSocket);
+
+ssize_t reactorSend(int clientSocket, WIRE_FRAME *wire);
+
+void drainReactor();
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * receivebuffer.c: Implementierung des Empfangspuffers der Verbindungen
+ *
+ * Jede Verbindung besitzt einen Ringpuffer, in den mit einem einzigen Systemaufruf
+ * so viele Daten gelesen werden, wie gerade vorhanden sind. Aus dem Puffer werden
+ * danach alle vollständigen Nachrichten entnommen. Eine unvollständige Nachricht
+ * bleibt im Puffer, bis der Rest mit dem nächsten Lesen eintrifft.
+ */
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <string.h>
+#include "receivebuffer.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+#define RECEIVE_BUFFER_MASK (RECEIVE_BUFFER_SIZE - 1)
+
+_Static_assert((RECEIVE_BUFFER_SIZE & RECEIVE_BUFFER_MASK) == 0, "Receive buffer size must be a power of two");
+_Static_assert(RECEIVE_BUFFER_SIZE >= sizeof(MESSAGE), "Receive buffer must hold a complete message");
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static void copyFromReceiveBuffer(RECEIVE_BUFFER *buffer, char *target, size_t length);
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+void initReceiveBuffer(RECEIVE_BUFFER *buffer) {
+    buffer->head = 0;
+    buffer->tail = 0;
+}
+
+ssize_t fillReceiveBuffer(RECEIVE_BUFFER *buffer, int socketId) {
+    // The free space may wrap around the end of the buffer, so it is read into two parts at once
+    size_t used = buffer->tail - buffer->head;
+    size_t space = RECEIVE_BUFFER_SIZE - used;
+    size_t offset = buffer->tail & RECEIVE_BUFFER_MASK;
+    size_t firstLength = RECEIVE_BUFFER_SIZE - offset < space ? RECEIVE_BUFFER_SIZE - offset : space;
+
+    struct iovec parts[2];
+    parts[0].iov_base = buffer->data + offset;
+    parts[0].iov_len = firstLength;
+    parts[1].iov_base = buffer->data;
+    parts[1].iov_len = space - firstLength;
+
+    struct msghdr header = {0};
+    header.msg_iov = parts;
+    header.msg_iovlen = parts[1].iov_len > 0 ? 2 : 1;
+    ssize_t readSize = recvmsg(socketId, &header, MSG_DONTWAIT);
+    if (readSize > 0) {
+        buffer->tail += readSize;
+    }
+    return readSize;
+}
+
+size_t appendReceiveBuffer(RECEIVE_BUFFER *buffer, const char *data, size_t length) {
+    size_t space = RECEIVE_BUFFER_SIZE - (buffer->tail - buffer->head);
+    if (length > space) {
+        length = space;
+    }
+
+    size_t offset = buffer->tail & RECEIVE_BUFFER_MASK;
+    size_t firstLength = RECEIVE_BUFFER_SIZE - offset < length ? RECEIVE_BUFFER_SIZE - offset : length;
+    memcpy(buffer->data + offset, data, firstLength);
+    memcpy(buffer->data, data + firstLength, length - firstLength);
+    buffer->tail += length;
+    return length;
+}
+
+//return 0 if no complete message is buffered, -1 if the buffered message is malformed
+ssize_t nextReceivedMessage(RECEIVE_BUFFER *buffer, MESSAGE *message) {
+    size_t used = buffer->tail - buffer->head;
+    if (used < sizeof(HEADER)) {
+        return 0;
+    }
+
+    // Look at the header first, the body is only copied once it is complete
+    char frame[sizeof(MESSAGE)];
+    copyFromReceiveBuffer(buffer, frame, sizeof(HEADER));
+    ssize_t frameSize = unpackMessage(frame, sizeof(HEADER), message);
+    if (frameSize < 0) {
+        return -1;
+    } else if (frameSize == 0) {
+        size_t bodyLength = message->header.length;
+        if (used < sizeof(HEADER) + bodyLength) {
+            return 0;
+        }
+        copyFromReceiveBuffer(buffer, frame, sizeof(HEADER) + bodyLength);
+        frameSize = unpackMessage(frame, sizeof(HEADER) + bodyLength, message);
+    }
+
+    buffer->head += frameSize;
+    return frameSize;
+}
+
+//return the number of bytes not handled yet, they are copied to target (RECEIVE_BUFFER_SIZE large)
+size_t copyUnhandledData(RECEIVE_BUFFER *buffer, char *target) {
+    size_t used = buffer->tail - buffer->head;
+    copyFromReceiveBuffer(buffer, target, used);
+    return used;
+}
+
+static void copyFromReceiveBuffer(RECEIVE_BUFFER *buffer, char *target, size_t length) {
+    size_t offset = buffer->head & RECEIVE_BUFFER_MASK;
+    size_t firstLength = RECEIVE_BUFFER_SIZE - offset < length ? RECEIVE_BUFFER_SIZE - offset : length;
+    memcpy(target, buffer->data + offset, firstLength);
+    memcpy(target + firstLength, buffer->data, length - firstLength);
+}
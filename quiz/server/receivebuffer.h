@@ -0,0 +1,34 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * receivebuffer.h: Header für den Empfangspuffer der Verbindungen
+ */
+#ifndef RECEIVEBUFFER_H
+#define RECEIVEBUFFER_H
+
+#include <sys/types.h>
+#include "rfc.h"
+
+// Must be a power of two and hold at least one complete message
+#define RECEIVE_BUFFER_SIZE 4096
+
+typedef struct {
+    size_t head;
+    size_t tail;
+    char data[RECEIVE_BUFFER_SIZE];
+} RECEIVE_BUFFER;
+
+void initReceiveBuffer(RECEIVE_BUFFER *buffer);
+
+ssize_t fillReceiveBuffer(RECEIVE_BUFFER *buffer, int socketId);
+
+size_t appendReceiveBuffer(RECEIVE_BUFFER *buffer, const char *data, size_t length);
+
+ssize_t nextReceivedMessage(RECEIVE_BUFFER *buffer, MESSAGE *message);
+
+size_t copyUnhandledData(RECEIVE_BUFFER *buffer, char *target);
+
+#endif
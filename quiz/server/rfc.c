@@ -14,38 +14,29 @@
  * (dessen Größe bekannt ist) empfangen und auswerten.
  */
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <string.h>
 #include <arpa/inet.h>
 #include "rfc.h"
 #include "../common/util.h"
-
-//------------------------------------------------------------------------------
-// Type definition
-//------------------------------------------------------------------------------
-enum {
-    DIRECTION_RECEIVE = 1,
-    DIRECTION_SEND = 2
-};
+#include "reactor.h"
+#include "sendqueue.h"
 
 //------------------------------------------------------------------------------
 // Implementations
 //------------------------------------------------------------------------------
-static void fixRFCHeader(MESSAGE *message, int direction) {
-    message->header.length = direction == DIRECTION_RECEIVE ?
-                             ntohs(message->header.length) :
-                             htons(message->header.length);
+static void fixRFCHeader(MESSAGE *message) {
+    message->header.length = ntohs(message->header.length);
 }
 
-static void fixRFCBody(MESSAGE *message, int direction) {
+static void fixRFCBody(MESSAGE *message) {
     /**
      * Wenn man ein Feld vom typ uint_16 benutzt, einmal die byte order per ntohs() umdrehen
      * Wenn man ein Feld vom typ uint_32+ benutzt, einmal die byte order per ntohl() umdrehen
      */
     switch (message->header.type) {
         case TYPE_LOGIN_REQUEST:
-            if (direction == DIRECTION_RECEIVE) {
-                message->body.loginRequest.name[message->header.length - 1] = '\0';
-            };
+            message->body.loginRequest.name[message->header.length - 1] = '\0';
             break;
         case TYPE_LOGIN_RESPONSE_OK:
             break;
@@ -54,27 +45,13 @@ static void fixRFCBody(MESSAGE *message, int direction) {
         case TYPE_CATALOG_RESPONSE:
             break;
         case TYPE_CATALOG_CHANGE:
-            if (direction == DIRECTION_RECEIVE) {
-                message->body.catalogChange.fileName[message->header.length] = '\0';
-            };
+            message->body.catalogChange.fileName[message->header.length] = '\0';
             break;
         case TYPE_PLAYER_LIST:
-            if (direction == DIRECTION_RECEIVE) {
-                int playerCount = message->header.length / sizeof(PLAYER);
-                for (int i = 0; i < playerCount; i++) {
-                    message->body.playerList.players[i].score = ntohl(message->body.playerList.players[i].score);
-                }
-            } else {
-                int playerCount = message->header.length / sizeof(PLAYER);
-                for (int i = 0; i < playerCount; i++) {
-                    message->body.playerList.players[i].score = htonl(message->body.playerList.players[i].score);
-                }
-            }
+            // Message to send
             break;
         case TYPE_START_GAME:
-            if (direction == DIRECTION_RECEIVE) {
-                message->body.startGame.catalog[message->header.length] = '\0';
-            };
+            message->body.startGame.catalog[message->header.length] = '\0';
             break;
         case TYPE_QUESTION_REQUEST:
             break;
@@ -85,52 +62,38 @@ static void fixRFCBody(MESSAGE *message, int direction) {
         case TYPE_QUESTION_RESULT:
             break;
         case TYPE_GAME_OVER:
-            if (direction == DIRECTION_RECEIVE) {
-                message->body.gameOver.score = ntohl(message->body.gameOver.score);
-            } else {
-                message->body.gameOver.score = htonl(message->body.gameOver.score);
-            }
+            message->body.gameOver.score = ntohl(message->body.gameOver.score);
             break;
         case TYPE_ERROR_WARNING:
-            if (direction == DIRECTION_RECEIVE) {
-                message->body.errorWarning.message[message->header.length] = '\0';
-            };
+            message->body.errorWarning.message[message->header.length] = '\0';
             break;
         default:
             break;
     }
 }
 
-ssize_t receiveMessage(int socketId, MESSAGE *message) {
-    ssize_t headerSize = recv(socketId, &message->header, sizeof(message->header), MSG_WAITALL);
-    if (headerSize == sizeof(message->header)) {
-        fixRFCHeader(message, DIRECTION_RECEIVE);
-        uint16_t bodyLength = message->header.length;
-        debugPrint("====== GOT MESSAGE ======");
-        debugPrint("Socket:\t\t\t%d", socketId);
-        debugPrint("Type:\t\t\t%d", message->header.type);
-        debugPrint("Header size:\t\t%zu", headerSize);
-        debugPrint("Header's body length:\t%lu", (unsigned long) bodyLength);
-        if (bodyLength == 0) {
-            debugPrint("(Non-)read body length:\t%d", 0);
-            debugPrint("//////// SUCCESS ////////");
-            return headerSize;
-        } else if (bodyLength > sizeof(message->body)) {
-            debugPrint("TOO LONG MESSAGE");
-            debugPrint("\\\\\\\\\\ FAILURE-MESSAGE \\\\\\\\");
-            return 0;
-        }
-        ssize_t bodySize = recv(socketId, &message->body, bodyLength, MSG_WAITALL);
-        debugPrint("Read body length:\t%zu", bodySize);
-        if (bodySize == bodyLength) {
-            fixRFCBody(message, DIRECTION_RECEIVE);
-            debugPrint("//////// SUCCESS ////////");
-            return headerSize + bodySize;
-        }
+ssize_t unpackMessage(const char *data, size_t length, MESSAGE *message) {
+    if (length < sizeof(HEADER)) {
+        return 0;
     }
 
-    debugPrint("\\\\\\\\\\\\\\\\ FAILURE \\\\\\\\\\\\\\\\");
-    return headerSize;
+    memcpy(&message->header, data, sizeof(HEADER));
+    fixRFCHeader(message);
+    uint16_t bodyLength = message->header.length;
+    if (bodyLength > sizeof(message->body)) {
+        debugPrint("TOO LONG MESSAGE");
+        return -1;
+    }
+    if (length < sizeof(HEADER) + bodyLength) {
+        return 0;
+    }
+
+    memcpy(&message->body, data + sizeof(HEADER), bodyLength);
+    fixRFCBody(message);
+    debugPrint("====== UNPACKED MESSAGE ======");
+    debugPrint("Type:\t\t\t%d", message->header.type);
+    debugPrint("Header's body length:\t%lu", (unsigned long) bodyLength);
+    return sizeof(HEADER) + bodyLength;
 }
 
 int validateMessage(MESSAGE *message) {
@@ -205,29 +168,87 @@ int validateMessage(MESSAGE *message) {
     return 1;
 }
 
-ssize_t sendMessage(int socketId, MESSAGE *message) {
-    // Get that header length before reversing byte orders
-    uint16_t headerLength = message->header.length;
-    size_t completeLength = sizeof(HEADER) + headerLength;
+//Builds the message in network byte order once, so it can be sent to any number of sockets. Returns NULL on error.
+WIRE_FRAME *encodeMessage(const MESSAGE *message) {
+    uint16_t bodyLength = message->header.length;
+    HEADER header;
+    header.type = message->header.type;
+    header.length = htons(bodyLength);
+    int priority = SEND_PRIORITY_NORMAL;
+    int sendFlags = SEND_FLAG_NONE;
 
-    debugPrint("==== SENDING MESSAGE ====");
-    debugPrint("Socket:\t\t%d", socketId);
-    debugPrint("Type:\t\t\t%d", message->header.type);
-    debugPrint("Header's body length:\t%lu", (unsigned long) headerLength);
-    debugPrint("Complete length:\t%zu", completeLength);
+    // Only bodies with multi-byte fields are copied to swap their byte order, all others are sent from the message
+    BODY swappedBody;
+    const void *body = &message->body;
+    switch (message->header.type) {
+        case TYPE_QUESTION:
+        case TYPE_QUESTION_RESULT:
+            // The player is waiting for these, they overtake everything else that is still queued
+            priority = SEND_PRIORITY_HIGH;
+            break;
+        case TYPE_GAME_OVER:
+            swappedBody.gameOver = message->body.gameOver;
+            swappedBody.gameOver.score = htonl(message->body.gameOver.score);
+            body = &swappedBody;
+            break;
+        default:
+            break;
+    }
+
+    struct iovec parts[2];
+    parts[0].iov_base = &header;
+    parts[0].iov_len = sizeof(HEADER);
+    parts[1].iov_base = (void *) body;
+    parts[1].iov_len = bodyLength;
+    WIRE_FRAME *wire = createWireFrame(parts, 2, priority, sendFlags);
+    if (wire == NULL) {
+        errorPrint("Could not allocate wire frame!");
+    }
+    return wire;
+}
+
+//The body has exactly as many players as given, so large rooms do not blow up every MESSAGE. Returns NULL on error.
+WIRE_FRAME *encodePlayerList(const PLAYER players[], int playerCount) {
+    if (debugEnabled()) {
+        if (sizeof(PLAYER) != 37) {
+            errorPrint("Size of PLAYER struct is not 37 anymore!");
+        }
+    }
 
-    // Reverse byte order (do body first because we can then access the header)
-    fixRFCBody(message, DIRECTION_SEND);
-    fixRFCHeader(message, DIRECTION_SEND);
+    HEADER header;
+    header.type = TYPE_PLAYER_LIST;
+    header.length = htons((uint16_t) (playerCount * sizeof(PLAYER)));
 
-    ssize_t sendSize = send(socketId, message, completeLength, 0);
-    debugPrint("Sent length:\t\t%zu", sendSize);
+    struct iovec parts[2];
+    parts[0].iov_base = &header;
+    parts[0].iov_len = sizeof(HEADER);
+    parts[1].iov_base = (void *) players;
+    parts[1].iov_len = playerCount * sizeof(PLAYER);
+    // A player list waits behind everything else and may be replaced by a newer one
+    WIRE_FRAME *wire = createWireFrame(parts, 2, SEND_PRIORITY_LOW, SEND_FLAG_SUMMARY);
+    if (wire == NULL) {
+        errorPrint("Could not allocate wire frame!");
+        return NULL;
+    }
+
+    // The scores are swapped in the copy, the caller keeps its list
+    PLAYER *wirePlayers = (PLAYER *) (wire->data + sizeof(HEADER));
+    for (int i = 0; i < playerCount; i++) {
+        wirePlayers[i].score = htonl(wirePlayers[i].score);
+    }
+    return wire;
+}
+
+ssize_t sendWireFrame(int socketId, WIRE_FRAME *wire) {
+    debugPrint("==== SENDING MESSAGE ====");
+    debugPrint("Socket:\t\t%d", socketId);
+    debugPrint("Type:\t\t\t%d", ((HEADER *) wire->data)->type);
+    debugPrint("Complete length:\t%zu", wire->length);
 
-    // Undo reverse of byte order (important for sending message more than once!)
-    fixRFCHeader(message, DIRECTION_RECEIVE);
-    fixRFCBody(message, DIRECTION_RECEIVE);
+    ssize_t sendSize = reactorSend(socketId, wire);
+    debugPrint("Sent length:\t\t%zd", sendSize);
 
-    if (sendSize == completeLength) {
+    if (sendSize == (ssize_t) wire->length) {
         debugPrint("//////// SUCCESS ////////");
         return sendSize;
     }
@@ -236,6 +257,16 @@ ssize_t sendMessage(int socketId, MESSAGE *message) {
     return -1;
 }
 
+ssize_t sendMessage(int socketId, const MESSAGE *message) {
+    WIRE_FRAME *wire = encodeMessage(message);
+    if (wire == NULL) {
+        return -1;
+    }
+    ssize_t sendSize = sendWireFrame(socketId, wire);
+    releaseWireFrame(wire);
+    return sendSize;
+}
+
 MESSAGE buildLoginResponseOk(uint8_t rfcVersion, uint8_t maxPlayerCount, uint8_t clientId) {
     MESSAGE msg;
     msg.header.type = TYPE_LOGIN_RESPONSE_OK;
@@ -262,20 +293,6 @@ MESSAGE buildCatalogChange(char catalogFileName[]) {
     return msg;
 }
 
-MESSAGE buildPlayerList(PLAYER players[], int playerCount) {
-    if (debugEnabled()) {
-        if (sizeof(PLAYER) != 37) {
-            errorPrint("Size of PLAYER struct is not 37 anymore!");
-        }
-    }
-
-    MESSAGE msg;
-    msg.header.type = TYPE_PLAYER_LIST;
-    msg.header.length = (uint16_t) (playerCount * sizeof(PLAYER));
-    memcpy(msg.body.playerList.players, players, sizeof(PLAYER) * playerCount);
-    return msg;
-}
-
 MESSAGE buildStartGame(/* nullable */ char catalogFileName[]) {
     MESSAGE msg;
     msg.header.type = TYPE_START_GAME;
@@ -15,11 +15,12 @@
 
 #include <sys/types.h>
 #include "../common/question.h"
+#include "sendqueue.h"
 
 #define RFC_VERSION 9
 #define RFC_CATALOG_FILE_MAX_LENGTH 32 // TODO FEEDBACK Use limits.h
 #define RFC_PLAYER_NAME_LENGTH 32
-#define RFC_PLAYER_COUNT_MAXIMUM 4
+#define RFC_PLAYER_COUNT_MAXIMUM 255 // maxPlayers and the player ids are one byte
 #define RFC_ERROR_WARNING_MAX_LENGTH 400
 
 //------------------------------------------------------------------------------
@@ -75,10 +76,6 @@ typedef struct {
     uint8_t id;
 } PLAYER;
 
-typedef struct {
-    PLAYER players[RFC_PLAYER_COUNT_MAXIMUM];
-} PLAYER_LIST;
-
 typedef struct {
     char catalog[RFC_CATALOG_FILE_MAX_LENGTH]; // optional in server to client responses
 } START_GAME;
@@ -117,7 +114,7 @@ typedef union {
     //CATALOG_REQUEST catalogRequest; // Is EMPTY -> useless
     CATALOG_RESPONSE catalogResponse;
     CATALOG_CHANGE catalogChange;
-    PLAYER_LIST playerList;
+    // The player list is as long as the room is full, it is encoded by encodePlayerList() only
     START_GAME startGame;
     //QUESTION_REQUEST questionRequest; // Is EMPTY -> useless
     QuestionMessage question;
@@ -136,11 +133,17 @@ typedef struct {
 //------------------------------------------------------------------------------
 // Methods for sending, receiving and building messages
 //------------------------------------------------------------------------------
-ssize_t receiveMessage(int socketId, MESSAGE *message);
+ssize_t unpackMessage(const char *data, size_t length, MESSAGE *message);
 
 int validateMessage(MESSAGE *message);
 
-ssize_t sendMessage(int socketId, MESSAGE *message);
+WIRE_FRAME *encodeMessage(const MESSAGE *message);
+
+WIRE_FRAME *encodePlayerList(const PLAYER players[], int playerCount);
+
+ssize_t sendWireFrame(int socketId, WIRE_FRAME *wire);
+
+ssize_t sendMessage(int socketId, const MESSAGE *message);
 
 MESSAGE buildLoginResponseOk(uint8_t rfcVersion, uint8_t maxPlayerCount, uint8_t clientId);
 
@@ -148,7 +151,6 @@ MESSAGE buildCatalogResponse(/* nullable */ char catalogFileName[]);
 
 MESSAGE buildCatalogChange(char catalogFileName[]);
 
-MESSAGE buildPlayerList(PLAYER players[], int playerCount);
 
 MESSAGE buildStartGame(/* nullable */ char catalogFileName[]);
 
@@ -8,39 +8,42 @@
  */
 #include "rfchelper.h"
 #include "user.h"
+#include "room.h"
 #include "../common/util.h"
 
 //------------------------------------------------------------------------------
 // Implementations
 //------------------------------------------------------------------------------
-void broadcastMessage(MESSAGE *message, char *text) {
-    broadcastMessageExcludeOneUser(message, text, -1, 1);
+void broadcastMessage(int roomId, const MESSAGE *message, char *text) {
+    broadcastMessageExcludeOneUser(roomId, message, text, -1);
 }
 
-void broadcastMessageWithoutLock(MESSAGE *message, char *text) {
-    broadcastMessageExcludeOneUser(message, text, -1, 0);
-}
+//Sends to the users of the newest roster, a caller that holds the room lock sends to the users as of now
+void broadcastMessageExcludeOneUser(int roomId, const MESSAGE *message, char *text, int excludedUserId) {
+    ROSTER *roster = acquireRoster(roomId);
+    if (roster == NULL) {
+        return;
+    }
 
-void broadcastMessageExcludeOneUser(MESSAGE *message, char *text, int excludedUserId, int doLockUserData) {
-    // We may need to lock user data because it may change during iteration
-    if (doLockUserData) {
-        lockUserData();
+    // Encode once, the send queues of all users share the same frame
+    WIRE_FRAME *wire = encodeMessage(message);
+    if (wire != NULL) {
+        broadcastWireFrame(roster, wire, text, excludedUserId);
     }
+    releaseWireFrame(wire);
+    releaseRoster(roster);
+}
 
-    // Send broadcast
-    for (int i = 0; i < getUserAmount(); i++) {
-        USER user = getUserByIndex(i);
-        if (user.id == excludedUserId) {
+//Needs no lock, users that have left since the roster was taken are skipped
+void broadcastWireFrame(const ROSTER *roster, WIRE_FRAME *wire, char *text, int excludedUserId) {
+    for (int i = 0; i < roster->playerCount; i++) {
+        const ROSTER_MEMBER *member = &roster->members[i];
+        if (member->userId == excludedUserId || !isUserOnSocket(member->userId, member->clientSocket)) {
             continue;
         }
 
-        if (sendMessage(user.clientSocket, message) < 0) {
-            errorPrint(text, user.username, user.id);
+        if (sendWireFrame(member->clientSocket, wire) < 0) {
+            errorPrint(text, roster->players[i].name, member->userId);
         }
     }
-
-    // Unlock after locking
-    if (doLockUserData) {
-        unlockUserData();
-    }
 }
@@ -10,11 +10,12 @@
 #define RFCHELPER_H
 
 #include "rfc.h"
+#include "roster.h"
 
-void broadcastMessage(MESSAGE *message, char *text);
+void broadcastMessage(int roomId, const MESSAGE *message, char *text);
 
-void broadcastMessageWithoutLock(MESSAGE *message, char *text);
+void broadcastMessageExcludeOneUser(int roomId, const MESSAGE *message, char *text, int excludedUserId);
 
-void broadcastMessageExcludeOneUser(MESSAGE *message, char *text, int excludedUserId, int lockUserData);
+void broadcastWireFrame(const ROSTER *roster, WIRE_FRAME *wire, char *text, int excludedUserId);
 
 #endif
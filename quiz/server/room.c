@@ -0,0 +1,347 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * room.c: Implementierung der Verwaltung der Spielräume
+ *
+ * Ein Prozess hostet bis zu maxRooms Spiele gleichzeitig. Neue Spieler kommen
+ * in den offenen Raum, bis dort das Spiel startet oder er voll ist, dann wird
+ * ein freier Raum geöffnet. Ein Raum wird erst beim ersten Gebrauch angelegt
+ * und danach wiederverwendet, sobald ihn der letzte Spieler verlassen hat.
+ * Die Raumtabelle (roomTableMutex) wird immer vor einem Raum gesperrt.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "room.h"
+#include "mutexhelper.h"
+#include "../common/util.h"
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static ROOM *createRoom(int roomId);
+
+static void openRoom(ROOM *room);
+
+static ROOM *takeFreeRoom();
+
+static void initSeat(void *entry);
+
+static void swapSeatOrder(ROOM *room, int position, int otherPosition);
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static pthread_mutex_t roomTableMutex;
+
+// A room is allocated when it is used the first time, so the table only holds pointers
+static ROOM **rooms = NULL;
+static int maxRoomCount = 0;
+static int roomCapacity = 0;
+
+static int openRoomId = -1; // The room new players join
+static int freeRoomCursor = 0; // Where the search for a free room goes on
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+int initRooms(int maxRooms, int capacity) {
+    if (mutexInit(&roomTableMutex, NULL) < 0) {
+        errorPrint("Could not init room table MUTEX!");
+        return -1;
+    }
+
+    rooms = calloc((size_t) maxRooms, sizeof(ROOM *));
+    if (rooms == NULL) {
+        errorPrint("Could not allocate the room table!");
+        return -2;
+    }
+    maxRoomCount = maxRooms;
+    roomCapacity = capacity;
+    return 0;
+}
+
+int getMaxRoomCount() {
+    return maxRoomCount;
+}
+
+//return how many players fit into one room
+int getRoomCapacity() {
+    return roomCapacity;
+}
+
+//return NULL if the room was never used
+ROOM *getRoom(int roomId) {
+    if (roomId < 0 || roomId >= maxRoomCount) {
+        return NULL;
+    }
+    return __atomic_load_n(&rooms[roomId], __ATOMIC_ACQUIRE);
+}
+
+void lockRoom(int roomId) {
+    mutexLock(&getRoom(roomId)->mutex);
+}
+
+void unlockRoom(int roomId) {
+    mutexUnlock(&getRoom(roomId)->mutex);
+}
+
+//return NULL if the seat was never used, then it is free
+SEAT *getSeat(ROOM *room, int seat) {
+    return getSlot(&room->seats, seat);
+}
+
+//Makes sure the seat exists before a user takes it, return NULL if there is no memory for it
+SEAT *reserveSeat(ROOM *room, int seat) {
+    return reserveSlot(&room->seats, seat);
+}
+
+//return the seat the next player gets or -1 if the room is full, the room has to be locked
+int getFreeSeat(ROOM *room) {
+    return room->userAmount < roomCapacity ? room->seatOrder[room->userAmount] : -1;
+}
+
+//return 1 if a user sits on the seat, the room has to be locked
+int isSeatTaken(ROOM *room, int seat) {
+    return room->seatPositions[seat] < room->userAmount;
+}
+
+//Moves the free seat to the taken ones, the room has to be locked
+void takeSeat(ROOM *room, int seat) {
+    swapSeatOrder(room, room->seatPositions[seat], room->userAmount);
+    room->userAmount++;
+}
+
+//Moves the taken seat to the free ones by swapping it with the last taken seat, the room has to be locked
+void leaveSeat(ROOM *room, int seat) {
+    room->userAmount--;
+    swapSeatOrder(room, room->seatPositions[seat], room->userAmount);
+}
+
+void startUserIteration(USER_ITERATOR *iterator, int roomId) {
+    iterator->room = getRoom(roomId);
+    iterator->position = 0;
+}
+
+//return NULL after the last user
+USER *nextUser(USER_ITERATOR *iterator) {
+    ROOM *room = iterator->room;
+    if (room == NULL || iterator->position >= room->userAmount) {
+        return NULL;
+    }
+    return &getSeat(room, room->seatOrder[iterator->position++])->user;
+}
+
+//return the newest roster of the room with a reference for the caller, NULL if there is none yet
+ROSTER *acquireRoster(int roomId) {
+    ROOM *room = getRoom(roomId);
+    if (room == NULL) {
+        return NULL;
+    }
+    mutexLock(&room->rosterMutex);
+    ROSTER *roster = room->roster != NULL ? retainRoster(room->roster) : NULL;
+    mutexUnlock(&room->rosterMutex);
+    return roster;
+}
+
+//Replaces the roster and takes over the reference of the caller, the room has to be locked
+void publishRoster(ROOM *room, ROSTER *roster) {
+    mutexLock(&room->rosterMutex);
+    ROSTER *oldRoster = room->roster;
+    room->roster = roster;
+    mutexUnlock(&room->rosterMutex);
+    // Readers that still hold the old roster keep it alive
+    releaseRoster(oldRoster);
+}
+
+//return the locked room a new player may join or -1 if all rooms are taken
+int lockOpenRoom() {
+    mutexLock(&roomTableMutex);
+
+    ROOM *room = getRoom(openRoomId);
+    if (room != NULL) {
+        mutexLock(&room->mutex);
+        if (room->gameState != GAME_STATE_PREPARATION || room->userAmount >= roomCapacity) {
+            mutexUnlock(&room->mutex);
+            room = NULL;
+        }
+    }
+    if (room == NULL) {
+        room = takeFreeRoom();
+        if (room == NULL) {
+            mutexUnlock(&roomTableMutex);
+            return -1;
+        }
+        mutexLock(&room->mutex);
+        openRoom(room);
+        openRoomId = room->id;
+        infoPrint("Opened room %d", room->id);
+    }
+
+    mutexUnlock(&roomTableMutex);
+    return room->id;
+}
+
+//return a fresh locked room for a matched group or -1 if all rooms are taken, it does not become the open room
+int lockNewRoom() {
+    mutexLock(&roomTableMutex);
+    ROOM *room = takeFreeRoom();
+    if (room == NULL) {
+        mutexUnlock(&roomTableMutex);
+        return -1;
+    }
+    mutexLock(&room->mutex);
+    openRoom(room);
+    infoPrint("Opened room %d for a match", room->id);
+
+    mutexUnlock(&roomTableMutex);
+    return room->id;
+}
+
+//Locks the room a user taken over from a previous server was in, return -1 if it runs another game
+int lockRoomForRestore(int roomId) {
+    if (roomId < 0 || roomId >= maxRoomCount) {
+        return -1;
+    }
+    mutexLock(&roomTableMutex);
+
+    ROOM *room = getRoom(roomId) != NULL ? getRoom(roomId) : createRoom(roomId);
+    if (room == NULL) {
+        mutexUnlock(&roomTableMutex);
+        return -1;
+    }
+    mutexLock(&room->mutex);
+    if (room->gameState == ROOM_STATE_FREE) {
+        openRoom(room);
+    } else if (room->gameState != GAME_STATE_PREPARATION) {
+        mutexUnlock(&room->mutex);
+        mutexUnlock(&roomTableMutex);
+        return -1;
+    }
+
+    mutexUnlock(&roomTableMutex);
+    return roomId;
+}
+
+//The room must not be locked by the caller
+void releaseRoomIfEmpty(int roomId) {
+    mutexLock(&roomTableMutex);
+    ROOM *room = getRoom(roomId);
+    mutexLock(&room->mutex);
+    if (room->gameState != ROOM_STATE_FREE && room->userAmount == 0) {
+        room->gameState = ROOM_STATE_FREE;
+        room->catalog = NULL;
+        if (openRoomId == roomId) {
+            openRoomId = -1;
+        }
+        infoPrint("Closed room %d", roomId);
+    }
+    mutexUnlock(&room->mutex);
+    mutexUnlock(&roomTableMutex);
+}
+
+//return the number of users in all rooms with the game state
+int getRoomUserCount(int gameState) {
+    int userCount = 0;
+    for (int i = 0; i < maxRoomCount; i++) {
+        ROOM *room = getRoom(i);
+        if (room != NULL) {
+            mutexLock(&room->mutex);
+            if (room->gameState == gameState) {
+                userCount += room->userAmount;
+            }
+            mutexUnlock(&room->mutex);
+        }
+    }
+    return userCount;
+}
+
+//Copies the ids of the users to userIds (room capacity large) if the room has the game state, return their number
+int collectRoomUserIds(int roomId, int gameState, int *userIds) {
+    ROOM *room = getRoom(roomId);
+    if (room == NULL) {
+        return 0;
+    }
+
+    int userCount = 0;
+    mutexLock(&room->mutex);
+    for (int i = 0; room->gameState == gameState && i < room->userAmount; i++) {
+        userIds[userCount++] = getSeat(room, room->seatOrder[i])->user.id;
+    }
+    mutexUnlock(&room->mutex);
+    return userCount;
+}
+
+//The room table has to be locked
+static ROOM *createRoom(int roomId) {
+    // The seats are allocated when players take them
+    ROOM *room = calloc(1, sizeof(ROOM));
+    if (room != NULL) {
+        room->seatOrder = malloc((size_t) roomCapacity * sizeof(int));
+        room->seatPositions = malloc((size_t) roomCapacity * sizeof(int));
+    }
+    if (room == NULL || room->seatOrder == NULL || room->seatPositions == NULL || mutexInit(&room->mutex, NULL) < 0
+        || mutexInit(&room->rosterMutex, NULL) < 0
+        || initSlotTable(&room->seats, roomCapacity, sizeof(SEAT), initSeat) < 0
+        || initHashIndex(&room->nameIndex, roomCapacity) < 0) {
+        errorPrint("Could not create room %d!", roomId);
+        if (room != NULL) {
+            free(room->seatOrder);
+            free(room->seatPositions);
+        }
+        free(room);
+        return NULL;
+    }
+    room->id = roomId;
+    room->gameState = ROOM_STATE_FREE;
+    initLeaderboard(&room->leaderboard, (uint32_t) roomId + 1);
+    initRoomMailbox(&room->mailbox, roomId);
+    __atomic_store_n(&rooms[roomId], room, __ATOMIC_RELEASE);
+    return room;
+}
+
+//Resets a free room for a new game, the room has to be locked
+static void openRoom(ROOM *room) {
+    // The room is empty, the first player has to get seat 0 to lead it
+    for (int seat = 0; seat < roomCapacity; seat++) {
+        room->seatOrder[seat] = seat;
+        room->seatPositions[seat] = seat;
+    }
+    room->gameState = GAME_STATE_PREPARATION;
+    room->selectedCatalogName[0] = '\0';
+    room->catalog = NULL;
+    room->finishedPlayerCount = 0;
+}
+
+//The room table has to be locked, return NULL if all rooms are taken
+static ROOM *takeFreeRoom() {
+    for (int i = 0; i < maxRoomCount; i++) {
+        int roomId = (freeRoomCursor + i) % maxRoomCount;
+        ROOM *room = getRoom(roomId);
+        if (room == NULL) {
+            room = createRoom(roomId);
+        }
+        if (room != NULL && room->gameState == ROOM_STATE_FREE) {
+            freeRoomCursor = (roomId + 1) % maxRoomCount;
+            return room;
+        }
+    }
+    return NULL;
+}
+
+static void initSeat(void *entry) {
+    SEAT *seat = entry;
+    seat->user.id = -1;
+    seat->user.clientSocket = -1;
+}
+
+static void swapSeatOrder(ROOM *room, int position, int otherPosition) {
+    int seat = room->seatOrder[position];
+    int otherSeat = room->seatOrder[otherPosition];
+    room->seatOrder[position] = otherSeat;
+    room->seatOrder[otherPosition] = seat;
+    room->seatPositions[otherSeat] = position;
+    room->seatPositions[seat] = otherPosition;
+}
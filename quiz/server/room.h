@@ -0,0 +1,138 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * room.h: Header für die Verwaltung der Spielräume
+ *
+ * Jeder Raum ist ein eigenes Spiel mit eigenem Zustand, eigenen Spielern,
+ * eigenem Katalog und eigenen Fragen-Sessions. Wie viele Spieler in einen
+ * Raum passen, wird beim Start festgelegt. Die Plätze eines Raumes liegen in
+ * einer Slot-Tabelle und belegen nur Speicher, wenn sie gebraucht werden.
+ * Der Platz ist die ID im RFC, Platz 0 ist der Spielleiter des Raumes.
+ * Die ID eines Users ist davon unabhängig (siehe user.c).
+ * Antworten zählen ihre Punkte ohne Lock auf den Zähler des Platzes, erst
+ * collectScores() übernimmt sie in den User und die Rangliste des Raumes.
+ * Jede Änderung der Spieler veröffentlicht eine neue Momentaufnahme (siehe
+ * roster.h), Listen und Broadcasts werden ohne den Raum-Lock daraus gebaut.
+ * Die Spiellogik eines Raumes läuft nur in seinem Aktor (siehe roomactor.h),
+ * der Raum-Lock schützt nur noch, was Login und Score-Agent mitbenutzen.
+ */
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "user.h"
+#include "catalog.h"
+#include "coroutine.h"
+#include "slottable.h"
+#include "leaderboard.h"
+#include "hashindex.h"
+#include "roster.h"
+#include "roomactor.h"
+#include "vardefine.h"
+
+enum {
+    ROOM_STATE_FREE = 0,
+    GAME_STATE_PREPARATION = 1,
+    GAME_STATE_GAME_RUNNING = 2,
+    GAME_STATE_FINISHED = 3,
+    GAME_STATE_ABORTED = 4
+};
+
+typedef struct {
+    COROUTINE coroutine; // Only resumed by the actor of the room
+    int event; // The event the session is resumed with
+    uint8_t selected; // The answer, if the event is an answer
+    int question; // Index of the current question
+    int answeredRound; // Synchronized rounds: the last round the player has got a result for
+} PLAYER_SESSION;
+
+// Answers add their points atomically without the room lock, each counter has its own cache line
+typedef struct {
+    unsigned int points __attribute__((aligned(64)));
+} SCORE_COUNTER;
+
+typedef struct {
+    USER user; // The id is -1 while the seat is free, the score is the one last collected
+    unsigned int version; // Odd while the user is written, getUser() reads it without the room lock
+    SCORE_COUNTER score;
+    PLAYER_SESSION session;
+    LEADERBOARD_NODE rankNode; // In the leaderboard of the room while the seat is taken
+} SEAT;
+
+typedef struct {
+    int id;
+    int gameState; // ROOM_STATE_FREE or one of the GAME_STATE_* values
+    pthread_mutex_t mutex; // Protects the users and the state the login and the score agent look at
+    ROOM_MAILBOX mailbox; // Commands for the actor that runs the game logic of the room
+    SLOT_TABLE seats; // SEAT entries, as many as the room capacity
+    HASH_INDEX nameIndex; // The taken seats by username
+    int *seatOrder; // The taken seats first (userAmount of them), then the free ones
+    int *seatPositions; // Where a seat is in seatOrder
+    int userAmount;
+    LEADERBOARD leaderboard; // The users sorted by score, updated with every score change
+    char selectedCatalogName[CATALOG_FILENAME_SIZE];
+    LOADED_CATALOG *catalog; // The catalog of the running game
+    int finishedPlayerCount;
+    int round; // Synchronized rounds: the question all players get, only used by the actor of the room
+    int answeredCount; // Synchronized rounds: the players with a result for the current round
+    WIRE_FRAME *roundResult; // Synchronized rounds: the result for an answer in time, encoded once per round
+    int scorePending; // The score agent has a player list to send
+    pthread_mutex_t rosterMutex; // Only held to swap the roster or to take a reference of it
+    ROSTER *roster; // The users as of the last change, replaced while the room is locked
+} ROOM;
+
+// Walks over the taken seats of a locked room, nobody may join or leave meanwhile
+typedef struct {
+    ROOM *room;
+    int position;
+} USER_ITERATOR;
+
+int initRooms(int maxRooms, int roomCapacity);
+
+int getMaxRoomCount();
+
+int getRoomCapacity();
+
+/* nullable */ ROOM *getRoom(int roomId);
+
+void lockRoom(int roomId);
+
+void unlockRoom(int roomId);
+
+/* nullable */ SEAT *getSeat(ROOM *room, int seat);
+
+/* nullable */ SEAT *reserveSeat(ROOM *room, int seat);
+
+int getFreeSeat(ROOM *room);
+
+int isSeatTaken(ROOM *room, int seat);
+
+void takeSeat(ROOM *room, int seat);
+
+void leaveSeat(ROOM *room, int seat);
+
+void startUserIteration(USER_ITERATOR *iterator, int roomId);
+
+/* nullable */ USER *nextUser(USER_ITERATOR *iterator);
+
+/* nullable */ ROSTER *acquireRoster(int roomId);
+
+void publishRoster(ROOM *room, ROSTER *roster);
+
+int lockOpenRoom();
+
+int lockNewRoom();
+
+int lockRoomForRestore(int roomId);
+
+void releaseRoomIfEmpty(int roomId);
+
+int getRoomUserCount(int gameState);
+
+int collectRoomUserIds(int roomId, int gameState, int *userIds);
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * roomactor.c: Implementierung der Aktoren der Spielräume
+ *
+ * Ein Aktor-Thread hat eine Warteschlange der Räume mit neuen Befehlen. Wer
+ * den ersten Befehl in einen ruhenden Briefkasten legt, reiht den Raum dort
+ * ein und weckt den Thread. Nach einem Schub kommt ein Raum mit weiteren
+ * Befehlen wieder hinten an die Reihe, damit die anderen Räume nicht warten.
+ */
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "roomactor.h"
+#include "room.h"
+#include "threadholder.h"
+#include "../common/util.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+typedef struct {
+    pthread_t threadId;
+    MPSC_QUEUE readyRooms; // ROOM_MAILBOX entries, only the actor thread takes them
+    sem_t wakeup; // Posted once for every room put into the ready queue
+} ROOM_ACTOR;
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static void *runRoomActor(void *argument);
+
+static void runMailbox(ROOM_ACTOR *actor, ROOM_MAILBOX *mailbox);
+
+static void scheduleMailbox(ROOM_ACTOR *actor, ROOM_MAILBOX *mailbox);
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static ROOM_ACTOR *actors = NULL;
+static int actorCount = 0;
+static void (*onCommand)(ROOM_COMMAND *command) = NULL;
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+int startRoomActors(int count, void (*handleCommand)(ROOM_COMMAND *command)) {
+    actors = calloc((size_t) count, sizeof(ROOM_ACTOR));
+    if (actors == NULL) {
+        errorPrint("Could not allocate the room actors!");
+        return -1;
+    }
+    onCommand = handleCommand;
+    actorCount = count;
+
+    for (int i = 0; i < count; i++) {
+        initMpscQueue(&actors[i].readyRooms);
+        if (sem_init(&actors[i].wakeup, 0, 0) < 0) {
+            errnoPrint("Could not init the semaphore of a room actor");
+            return -2;
+        }
+        if (pthread_create(&actors[i].threadId, NULL, runRoomActor, &actors[i]) != 0) {
+            errorPrint("Could not start room actor %d!", i);
+            return -3;
+        }
+        registerThread(actors[i].threadId);
+    }
+    infoPrint("Started %d room actors", count);
+    return 0;
+}
+
+void initRoomMailbox(ROOM_MAILBOX *mailbox, int roomId) {
+    initMpscQueue(&mailbox->commands);
+    mailbox->scheduled = 0;
+    mailbox->roomId = roomId;
+}
+
+//Can be called from any thread, the message is copied
+int postRoomCommand(int type, int roomId, int userId, int clientSocket, const MESSAGE *message) {
+    ROOM *room = getRoom(roomId);
+    if (room == NULL) {
+        return -1;
+    }
+    ROOM_COMMAND *command = malloc(sizeof(ROOM_COMMAND));
+    if (command == NULL) {
+        errorPrint("No memory left for a command to room %d!", roomId);
+        return -2;
+    }
+    command->type = type;
+    command->roomId = roomId;
+    command->userId = userId;
+    command->clientSocket = clientSocket;
+    if (message != NULL) {
+        memcpy(&command->message, message, sizeof(MESSAGE));
+    }
+
+    ROOM_MAILBOX *mailbox = &room->mailbox;
+    pushMpscQueue(&mailbox->commands, &command->node);
+    // Only the producer that wakes the mailbox hands it to the actor, every room is queued at most once
+    if (!__atomic_exchange_n(&mailbox->scheduled, 1, __ATOMIC_SEQ_CST)) {
+        scheduleMailbox(&actors[roomId % actorCount], mailbox);
+    }
+    return 0;
+}
+
+static void *runRoomActor(void *argument) {
+    ROOM_ACTOR *actor = argument;
+    while (1) {
+        sem_wait(&actor->wakeup);
+        // The semaphore counts the rooms, one that is not linked yet shows up soon
+        MPSC_NODE *node;
+        while ((node = popMpscQueue(&actor->readyRooms)) == NULL) {
+            sched_yield();
+        }
+        runMailbox(actor, (ROOM_MAILBOX *) node);
+    }
+    return NULL;
+}
+
+static void runMailbox(ROOM_ACTOR *actor, ROOM_MAILBOX *mailbox) {
+    for (int handled = 0; handled < ROOM_ACTOR_BATCH_SIZE; handled++) {
+        ROOM_COMMAND *command = (ROOM_COMMAND *) popMpscQueue(&mailbox->commands);
+        if (command == NULL) {
+            break;
+        }
+        onCommand(command);
+        free(command);
+    }
+
+    // Commands that are left or still being pushed get the next turn
+    if (!isMpscQueueEmpty(&mailbox->commands)) {
+        scheduleMailbox(actor, mailbox);
+        return;
+    }
+    __atomic_store_n(&mailbox->scheduled, 0, __ATOMIC_SEQ_CST);
+    // A producer that still saw the mailbox scheduled relies on this look
+    if (!isMpscQueueEmpty(&mailbox->commands) && !__atomic_exchange_n(&mailbox->scheduled, 1, __ATOMIC_SEQ_CST)) {
+        scheduleMailbox(actor, mailbox);
+    }
+}
+
+static void scheduleMailbox(ROOM_ACTOR *actor, ROOM_MAILBOX *mailbox) {
+    pushMpscQueue(&actor->readyRooms, &mailbox->node);
+    if (sem_post(&actor->wakeup) < 0) {
+        errnoPrint("Could not wake a room actor");
+    }
+}
@@ -0,0 +1,52 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * roomactor.h: Header für die Aktoren der Spielräume
+ *
+ * Jeder Raum hat einen Briefkasten. Reactoren und Timer führen die Spiellogik
+ * nicht mehr selbst aus, sondern legen Befehle hinein. Ein Raum gehört fest zu
+ * einem der Aktor-Threads, der seine Befehle nacheinander und in Schüben
+ * abarbeitet. So läuft die Logik eines Raumes immer in genau einem Thread und
+ * die Räume verteilen sich auf die Kerne.
+ */
+#ifndef ROOMACTOR_H
+#define ROOMACTOR_H
+
+#include "mpscqueue.h"
+#include "rfc.h"
+
+#define ROOM_ACTOR_BATCH_SIZE 32
+
+enum {
+    ROOM_COMMAND_MESSAGE = 1,
+    ROOM_COMMAND_DISCONNECT = 2,
+    ROOM_COMMAND_QUESTION_TIMEOUT = 3,
+    ROOM_COMMAND_ROUND_TIMEOUT = 4 // For the room, without a user
+};
+
+typedef struct {
+    MPSC_NODE node; // Has to be the first member
+    int type;
+    int roomId;
+    int userId;
+    int clientSocket; // The socket of the user when the command was posted
+    MESSAGE message; // Only for ROOM_COMMAND_MESSAGE
+} ROOM_COMMAND;
+
+typedef struct {
+    MPSC_NODE node; // In the ready queue of the actor while scheduled, has to be the first member
+    MPSC_QUEUE commands;
+    int scheduled; // Set by the producer that hands the mailbox to the actor
+    int roomId;
+} ROOM_MAILBOX;
+
+int startRoomActors(int actorCount, void (*handleCommand)(ROOM_COMMAND *command));
+
+void initRoomMailbox(ROOM_MAILBOX *mailbox, int roomId);
+
+int postRoomCommand(int type, int roomId, int userId, int clientSocket, /* nullable */ const MESSAGE *message);
+
+#endif
@@ -0,0 +1,41 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * roster.c: Implementierung der Momentaufnahmen der Spieler eines Raumes
+ *
+ * Spieler und Verwaltungsdaten liegen in einem Speicherblock, der mit der
+ * letzten Referenz freigegeben wird.
+ */
+#include <stdlib.h>
+#include "roster.h"
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+//The roster has one reference, return NULL if there is no memory
+ROSTER *createRoster(int playerCount) {
+    ROSTER *roster = malloc(sizeof(ROSTER) + (size_t) playerCount * (sizeof(PLAYER) + sizeof(ROSTER_MEMBER)));
+    if (roster == NULL) {
+        return NULL;
+    }
+    roster->references = 1;
+    roster->playerCount = playerCount;
+    roster->members = (ROSTER_MEMBER *) (roster + 1);
+    roster->players = (PLAYER *) (roster->members + playerCount);
+    return roster;
+}
+
+ROSTER *retainRoster(ROSTER *roster) {
+    __atomic_add_fetch(&roster->references, 1, __ATOMIC_RELAXED);
+    return roster;
+}
+
+void releaseRoster(ROSTER *roster) {
+    if (roster != NULL && __atomic_sub_fetch(&roster->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(roster);
+    }
+}
+
@@ -0,0 +1,36 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * roster.h: Header für die Momentaufnahmen der Spieler eines Raumes
+ *
+ * Eine Momentaufnahme wird nach dem Anlegen nicht mehr verändert. Der Raum
+ * ersetzt sie bei jeder Änderung durch eine neue (siehe room.c), Leser halten
+ * eine Referenz und dürfen ohne Raum-Lock über die Spieler gehen und senden.
+ */
+#ifndef ROSTER_H
+#define ROSTER_H
+
+#include "rfc.h"
+
+typedef struct {
+    int userId;
+    int clientSocket;
+} ROSTER_MEMBER;
+
+typedef struct {
+    int references;
+    int playerCount;
+    PLAYER *players; // By score, best first, the ids are the seats
+    ROSTER_MEMBER *members; // In the same order as the players
+} ROSTER;
+
+/* nullable */ ROSTER *createRoster(int playerCount);
+
+ROSTER *retainRoster(ROSTER *roster);
+
+void releaseRoster(/* nullable */ ROSTER *roster);
+
+#endif
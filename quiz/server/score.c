@@ -12,6 +12,8 @@
  * Achten Sie in diesem Modul besonders darauf, den Semaphor zum Triggern
  * des Score-Agents sauber wegzukapseln. Der Semaphor darf nur modul- und
  * nicht programmglobal sein.
+ * Jeder Raum hat seine eigene Spielerliste. notifyScoreAgent() merkt sich den
+ * Raum (höchstens einmal), der Score-Agent sendet dann nur dort die neue Liste.
  */
 
 #include <semaphore.h>
@@ -21,21 +23,44 @@
 #include <pthread.h>
 #include "rfc.h"
 #include "threadholder.h"
+#include "room.h"
+#include "rfchelper.h"
+#include "mutexhelper.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <memory.h>
 
 void startScoreAgent();
 
+static void sendPlayerList(int roomId);
+
 static pthread_t scoreThreadId = 0;
 static sem_t scoreAgentTrigger;
 
+// Rooms with a changed player list, each one at most once
+static pthread_mutex_t pendingRoomsMutex;
+static int *pendingRooms = NULL;
+static int *takenRooms = NULL;
+static int pendingRoomCount = 0;
+
 int initSemaphore() {
     return sem_init(&scoreAgentTrigger, 0, 0);
 }
 
-int notifyScoreAgent() {
-    return sem_post(&scoreAgentTrigger);
+int notifyScoreAgent(int roomId) {
+    ROOM *room = getRoom(roomId);
+    if (room == NULL) {
+        return -1;
+    }
+
+    mutexLock(&pendingRoomsMutex);
+    int wasPending = room->scorePending;
+    if (!wasPending) {
+        room->scorePending = 1;
+        pendingRooms[pendingRoomCount++] = roomId;
+    }
+    mutexUnlock(&pendingRoomsMutex);
+    return wasPending ? 0 : sem_post(&scoreAgentTrigger);
 }
 
 int startScoreAgentThread() {
@@ -47,6 +72,13 @@ int startScoreAgentThread() {
         return result;
     }
 
+    pendingRooms = malloc((size_t) getMaxRoomCount() * sizeof(int));
+    takenRooms = malloc((size_t) getMaxRoomCount() * sizeof(int));
+    if (pendingRooms == NULL || takenRooms == NULL || mutexInit(&pendingRoomsMutex, NULL) < 0) {
+        errorPrint("Error: Pending rooms of the score agent could not be created");
+        return -2;
+    }
+
     result = pthread_create(&scoreThreadId, NULL, (void *) &startScoreAgent, NULL);
     if (result != 0) {
         errorPrint("Error: Can't create Score agent thread");
@@ -64,22 +96,42 @@ void startScoreAgent() {
     while (1) {
         //Waits until semaphor is incremented/unlocked and decrements (locks) it again
         sem_wait(&scoreAgentTrigger);
+        // Notifications that came in meanwhile are covered by this player list, it is built from the newest scores
+        while (sem_trywait(&scoreAgentTrigger) == 0) {
+        }
+
+        // Take the pending rooms at once, rooms notified meanwhile are pending again
+        mutexLock(&pendingRoomsMutex);
+        int takenRoomCount = pendingRoomCount;
+        memcpy(takenRooms, pendingRooms, (size_t) takenRoomCount * sizeof(int));
+        for (int i = 0; i < takenRoomCount; i++) {
+            getRoom(takenRooms[i])->scorePending = 0;
+        }
+        pendingRoomCount = 0;
+        mutexUnlock(&pendingRoomsMutex);
 
-        //Create PlayerList
-        lockUserData();
-        PLAYER_LIST player_list = getPlayerListSortedByScore();// getPlayerList();
-
-        MESSAGE sendmessage = buildPlayerList(player_list.players, getUserAmount());
-        //fuer alle aktiven clients
-        for (int i = 0; i < getUserAmount(); i++) {
-            if (sendMessage(getSocketIdByUserId(player_list.players[i].id), &sendmessage) >= 0) {
-                debugPrint("Debug: ScoreAgent - PlayerList send");
-            } else {
-                errorPrint("Error: ScoreAgent Send Message PlayerList");
-            }
+        for (int i = 0; i < takenRoomCount; i++) {
+            sendPlayerList(takenRooms[i]);
         }
-        unlockUserData();
     }
 }
 
+static void sendPlayerList(int roomId) {
+    // Only collecting the scores needs the room, the list is built from the roster it publishes
+    lockRoom(roomId);
+    collectScores(roomId);
+    unlockRoom(roomId);
 
+    ROSTER *roster = acquireRoster(roomId);
+    if (roster == NULL) {
+        return;
+    }
+    //fuer alle aktiven clients des Raumes, die Spieler der Momentaufnahme sind schon nach Punkten sortiert
+    WIRE_FRAME *wire = encodePlayerList(roster->players, roster->playerCount);
+    if (wire != NULL) {
+        broadcastWireFrame(roster, wire, "Error: ScoreAgent Send Message PlayerList to %s (%d)", -1);
+        debugPrint("Debug: ScoreAgent - PlayerList send");
+    }
+    releaseWireFrame(wire);
+    releaseRoster(roster);
+}
@@ -18,7 +18,7 @@ int initSemaphore();
 //update Ranking
 void updateRanking();
 
-//increments (unlocks) Semaphore
-int notifyScoreAgent();
+//increments (unlocks) Semaphore, the score agent sends the player list of the room
+int notifyScoreAgent(int roomId);
 
 #endif
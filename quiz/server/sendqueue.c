@@ -0,0 +1,251 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * sendqueue.c: Implementierung der Sendewarteschlangen der Verbindungen
+ *
+ * Was nicht sofort gesendet werden kann, wird pro Verbindung in eine begrenzte
+ * Warteschlange gestellt und gesendet, sobald der Socket wieder schreibbar ist.
+ * Läuft die Warteschlange eines langsamen Clients über, greift die eingestellte
+ * Strategie: Der Client wird getrennt (DROP), oder es werden zuerst alle noch
+ * nicht gesendeten Zusammenfassungen (z.B. Spielerlisten) verworfen, sodass der
+ * Client nur noch die neueste erhält (SUMMARY). Reicht das nicht, wird er
+ * ebenfalls getrennt.
+ * Die Nachrichten selbst liegen nur einmal im Speicher: Ein Broadcast erzeugt
+ * einen WIRE_FRAME, auf den die Warteschlangen aller Empfänger verweisen.
+ * Jede Warteschlange hat eine Liste pro Priorität, Fragen und Ergebnisse
+ * überholen so z.B. die Spielerlisten. Eine noch nicht gesendete Spielerliste
+ * wird durch eine neuere ersetzt, statt dahinter eingereiht zu werden.
+ */
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "sendqueue.h"
+#include "vardefine.h"
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static void dropSummaryFrames(SEND_QUEUE *queue);
+
+static int replaceSummaryFrame(SEND_QUEUE *queue, SEND_FRAME *frame);
+
+static void removeSendFrame(SEND_QUEUE *queue, int priority, SEND_FRAME *previous, SEND_FRAME *frame);
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static int slowConsumerPolicy = SLOW_CONSUMER_POLICY_SUMMARY;
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+void setSlowConsumerPolicy(int policy) {
+    slowConsumerPolicy = policy;
+}
+
+void initSendQueue(SEND_QUEUE *queue) {
+    for (int i = 0; i < SEND_PRIORITY_COUNT; i++) {
+        queue->first[i] = NULL;
+        queue->last[i] = NULL;
+    }
+    queue->queuedBytes = 0;
+}
+
+//Copies the parts into one frame with a single reference, returns NULL on error
+WIRE_FRAME *createWireFrame(const struct iovec *parts, int partCount, int priority, int flags) {
+    size_t length = 0;
+    for (int i = 0; i < partCount; i++) {
+        length += parts[i].iov_len;
+    }
+
+    WIRE_FRAME *wire = malloc(sizeof(WIRE_FRAME) + length);
+    if (wire == NULL) {
+        return NULL;
+    }
+    wire->references = 1;
+    wire->priority = priority;
+    wire->flags = flags;
+    wire->length = length;
+
+    size_t copied = 0;
+    for (int i = 0; i < partCount; i++) {
+        memcpy(wire->data + copied, parts[i].iov_base, parts[i].iov_len);
+        copied += parts[i].iov_len;
+    }
+    return wire;
+}
+
+WIRE_FRAME *retainWireFrame(WIRE_FRAME *wire) {
+    __atomic_add_fetch(&wire->references, 1, __ATOMIC_RELAXED);
+    return wire;
+}
+
+void releaseWireFrame(WIRE_FRAME *wire) {
+    if (wire != NULL && __atomic_sub_fetch(&wire->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(wire);
+    }
+}
+
+//Takes a reference of the wire frame, returns NULL on error
+SEND_FRAME *createSendFrame(WIRE_FRAME *wire, size_t sent) {
+    SEND_FRAME *frame = malloc(sizeof(SEND_FRAME));
+    if (frame == NULL) {
+        return NULL;
+    }
+    frame->next = NULL;
+    frame->owner = NULL;
+    frame->wire = retainWireFrame(wire);
+    frame->sent = sent;
+    return frame;
+}
+
+void freeSendFrame(SEND_FRAME *frame) {
+    releaseWireFrame(frame->wire);
+    free(frame);
+}
+
+//return -1 if the consumer is too slow, then the frame is freed and the queue is cleared
+int enqueueSendFrame(SEND_QUEUE *queue, SEND_FRAME *frame, size_t bytesInFlight) {
+    // Only the newest summary is of interest, so it takes the place of an older one that is still waiting
+    if ((frame->wire->flags & SEND_FLAG_SUMMARY) && frame->sent == 0 && replaceSummaryFrame(queue, frame)) {
+        return 0;
+    }
+
+    if (queue->queuedBytes + bytesInFlight + frame->wire->length > MAXSENDQUEUEBYTES) {
+        if (slowConsumerPolicy == SLOW_CONSUMER_POLICY_SUMMARY) {
+            dropSummaryFrames(queue);
+        }
+        if (queue->queuedBytes + bytesInFlight + frame->wire->length > MAXSENDQUEUEBYTES) {
+            freeSendFrame(frame);
+            clearSendQueue(queue);
+            return -1;
+        }
+    }
+
+    int priority = frame->wire->priority;
+    if (queue->last[priority] == NULL) {
+        queue->first[priority] = frame;
+    } else {
+        queue->last[priority]->next = frame;
+    }
+    queue->last[priority] = frame;
+    queue->queuedBytes += frame->wire->length;
+    return 0;
+}
+
+SEND_FRAME *peekSendFrame(SEND_QUEUE *queue) {
+    // A partly sent frame has to be finished first, no matter what its priority is
+    for (int priority = 0; priority < SEND_PRIORITY_COUNT; priority++) {
+        if (queue->first[priority] != NULL && queue->first[priority]->sent > 0) {
+            return queue->first[priority];
+        }
+    }
+    for (int priority = 0; priority < SEND_PRIORITY_COUNT; priority++) {
+        if (queue->first[priority] != NULL) {
+            return queue->first[priority];
+        }
+    }
+    return NULL;
+}
+
+SEND_FRAME *dequeueSendFrame(SEND_QUEUE *queue) {
+    SEND_FRAME *frame = peekSendFrame(queue);
+    if (frame != NULL) {
+        removeSendFrame(queue, frame->wire->priority, NULL, frame);
+    }
+    return frame;
+}
+
+int isSendQueueEmpty(const SEND_QUEUE *queue) {
+    return queue->queuedBytes == 0;
+}
+
+//return the number of bytes still queued or -1 if the socket failed
+ssize_t flushSendQueue(SEND_QUEUE *queue, int socketId) {
+    SEND_FRAME *frame;
+    while ((frame = peekSendFrame(queue)) != NULL) {
+        ssize_t sendSize = send(socketId, frame->wire->data + frame->sent, frame->wire->length - frame->sent,
+                                MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sendSize < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                break;
+            }
+            return -1;
+        }
+
+        frame->sent += sendSize;
+        if (frame->sent < frame->wire->length) {
+            break;
+        }
+        freeSendFrame(dequeueSendFrame(queue));
+    }
+    return (ssize_t) queue->queuedBytes;
+}
+
+//Copies what is not sent yet in sending order to target (queuedBytes large) and empties the queue, return the length
+size_t takeUnsentData(SEND_QUEUE *queue, char *target) {
+    size_t copied = 0;
+    SEND_FRAME *frame;
+    while ((frame = dequeueSendFrame(queue)) != NULL) {
+        memcpy(target + copied, frame->wire->data + frame->sent, frame->wire->length - frame->sent);
+        copied += frame->wire->length - frame->sent;
+        freeSendFrame(frame);
+    }
+    return copied;
+}
+
+void clearSendQueue(SEND_QUEUE *queue) {
+    while (!isSendQueueEmpty(queue)) {
+        freeSendFrame(dequeueSendFrame(queue));
+    }
+}
+
+static void dropSummaryFrames(SEND_QUEUE *queue) {
+    // Partly sent frames have to be completed, otherwise the stream would be broken
+    for (int priority = 0; priority < SEND_PRIORITY_COUNT; priority++) {
+        SEND_FRAME *previous = NULL;
+        SEND_FRAME *frame = queue->first[priority];
+        while (frame != NULL) {
+            SEND_FRAME *next = frame->next;
+            if ((frame->wire->flags & SEND_FLAG_SUMMARY) && frame->sent == 0) {
+                removeSendFrame(queue, priority, previous, frame);
+                freeSendFrame(frame);
+            } else {
+                previous = frame;
+            }
+            frame = next;
+        }
+    }
+}
+
+//return 1 if a waiting summary was replaced by the frame, which is freed then
+static int replaceSummaryFrame(SEND_QUEUE *queue, SEND_FRAME *frame) {
+    for (SEND_FRAME *queued = queue->first[frame->wire->priority]; queued != NULL; queued = queued->next) {
+        if ((queued->wire->flags & SEND_FLAG_SUMMARY) && queued->sent == 0) {
+            WIRE_FRAME *oldWire = queued->wire;
+            queue->queuedBytes = queue->queuedBytes - oldWire->length + frame->wire->length;
+            queued->wire = frame->wire;
+            frame->wire = oldWire;
+            freeSendFrame(frame);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void removeSendFrame(SEND_QUEUE *queue, int priority, SEND_FRAME *previous, SEND_FRAME *frame) {
+    if (previous == NULL) {
+        queue->first[priority] = frame->next;
+    } else {
+        previous->next = frame->next;
+    }
+    if (queue->last[priority] == frame) {
+        queue->last[priority] = previous;
+    }
+    queue->queuedBytes -= frame->wire->length;
+    frame->next = NULL;
+}
@@ -0,0 +1,85 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * sendqueue.h: Header für die Sendewarteschlangen der Verbindungen
+ */
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+enum {
+    SLOW_CONSUMER_POLICY_DROP = 1,
+    SLOW_CONSUMER_POLICY_SUMMARY = 2
+};
+
+// Queued frames of a higher priority are sent first, within one priority the order is kept
+enum {
+    SEND_PRIORITY_HIGH = 0, // Questions and their results, a player is waiting for them
+    SEND_PRIORITY_NORMAL = 1,
+    SEND_PRIORITY_LOW = 2, // Summaries like the player list
+    SEND_PRIORITY_COUNT = 3
+};
+
+enum {
+    SEND_FLAG_NONE = 0,
+    SEND_FLAG_SUMMARY = 1 // The frame is only a summary and may be replaced by a newer one
+};
+
+// A message in wire format. It is never changed after its creation and shared by the send queues
+// of all its receivers, the last one releasing it frees it.
+typedef struct {
+    int references;
+    int priority;
+    int flags;
+    size_t length;
+    char data[];
+} WIRE_FRAME;
+
+// The entry of one wire frame in the send queue of one connection
+typedef struct send_frame {
+    struct send_frame *next;
+    void *owner;
+    WIRE_FRAME *wire;
+    size_t sent;
+} SEND_FRAME;
+
+typedef struct {
+    SEND_FRAME *first[SEND_PRIORITY_COUNT];
+    SEND_FRAME *last[SEND_PRIORITY_COUNT];
+    size_t queuedBytes;
+} SEND_QUEUE;
+
+void setSlowConsumerPolicy(int policy);
+
+void initSendQueue(SEND_QUEUE *queue);
+
+WIRE_FRAME *createWireFrame(const struct iovec *parts, int partCount, int priority, int flags);
+
+WIRE_FRAME *retainWireFrame(WIRE_FRAME *wire);
+
+void releaseWireFrame(WIRE_FRAME *wire);
+
+SEND_FRAME *createSendFrame(WIRE_FRAME *wire, size_t sent);
+
+void freeSendFrame(SEND_FRAME *frame);
+
+int enqueueSendFrame(SEND_QUEUE *queue, SEND_FRAME *frame, size_t bytesInFlight);
+
+SEND_FRAME *peekSendFrame(SEND_QUEUE *queue);
+
+SEND_FRAME *dequeueSendFrame(SEND_QUEUE *queue);
+
+int isSendQueueEmpty(const SEND_QUEUE *queue);
+
+ssize_t flushSendQueue(SEND_QUEUE *queue, int socketId);
+
+size_t takeUnsentData(SEND_QUEUE *queue, char *target);
+
+void clearSendQueue(SEND_QUEUE *queue);
+
+#endif
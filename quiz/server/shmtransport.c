@@ -0,0 +1,196 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * shmtransport.c: Implementierung des Shared-Memory-Transports lokaler Clients
+ *
+ * Bots und Lastgeneratoren, die auf demselben Rechner laufen, sollen weder den
+ * TCP-Stack belasten noch die Latenzmessungen verfälschen. Sie können ihre
+ * Nachrichten deshalb über zwei Ringpuffer in gemeinsamem Speicher austauschen
+ * (siehe shmtransport.h). Der Server schreibt nur ganze Nachrichten in den Ring
+ * zum Client. Passt eine Nachricht nicht mehr hinein, bleibt sie in der
+ * Sendewarteschlange der Verbindung, bis der Client Platz gemacht und geklingelt hat.
+ * Der memfd muss gegen Verkleinern und Vergrößern versiegelt sein. Sonst könnte
+ * der Client ihn nach der Prüfung kürzen, und der nächste Zugriff des Servers
+ * auf den Ring würde ihn mit SIGBUS beenden.
+ */
+#define _GNU_SOURCE // F_GET_SEALS
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "shmtransport.h"
+#include "../common/util.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+#define SHM_RING_MASK (SHM_RING_SIZE - 1)
+
+_Static_assert((SHM_RING_SIZE & SHM_RING_MASK) == 0, "Shared memory ring size must be a power of two");
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static SHM_CHANNEL *mapSharedMemoryChannel(int memoryFileDescriptor);
+
+static void ringDoorbell(int socketId);
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+//Receives like recv(), a passed memory descriptor is mapped as channel if the data starts with the attach request
+ssize_t receiveSharedMemoryAttach(int socketId, char *buffer, size_t length, SHM_CHANNEL **channel) {
+    struct iovec part;
+    part.iov_base = buffer;
+    part.iov_len = length;
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr header = {0};
+    header.msg_iov = &part;
+    header.msg_iovlen = 1;
+    header.msg_control = control.buffer;
+    header.msg_controllen = sizeof(control.buffer);
+    ssize_t readSize = recvmsg(socketId, &header, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (readSize <= 0) {
+        return readSize;
+    }
+
+    struct cmsghdr *controlMessage = CMSG_FIRSTHDR(&header);
+    if (controlMessage != NULL && controlMessage->cmsg_level == SOL_SOCKET && controlMessage->cmsg_type == SCM_RIGHTS) {
+        int memoryFileDescriptor;
+        memcpy(&memoryFileDescriptor, CMSG_DATA(controlMessage), sizeof(int));
+        if (buffer[0] == SHM_ATTACH_REQUEST && *channel == NULL) {
+            *channel = mapSharedMemoryChannel(memoryFileDescriptor);
+        }
+        close(memoryFileDescriptor);
+    }
+    return readSize;
+}
+
+void unmapSharedMemoryChannel(SHM_CHANNEL *channel) {
+    if (channel != NULL) {
+        munmap(channel, sizeof(SHM_CHANNEL));
+    }
+}
+
+//return the number of bytes read, a waiting producer gets a doorbell on the socket
+size_t readSharedMemoryRing(SHM_RING *ring, char *target, size_t length, int socketId) {
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t tail = ring->tail;
+    size_t used = head - tail;
+    if (used > SHM_RING_SIZE) {
+        // The other side broke the ring, nothing in it can be trusted
+        return 0;
+    }
+    if (length > used) {
+        length = used;
+    }
+
+    size_t offset = tail & SHM_RING_MASK;
+    size_t firstLength = SHM_RING_SIZE - offset < length ? SHM_RING_SIZE - offset : length;
+    memcpy(target, ring->data + offset, firstLength);
+    memcpy(target + firstLength, ring->data, length - firstLength);
+    __atomic_store_n(&ring->tail, tail + length, __ATOMIC_SEQ_CST);
+
+    if (length > 0 && __atomic_exchange_n(&ring->producerWaiting, 0, __ATOMIC_SEQ_CST)) {
+        ringDoorbell(socketId);
+    }
+    return length;
+}
+
+//return 1 if the data was written as a whole, 0 if the ring is too full (the consumer rings when there is space)
+int writeSharedMemoryRing(SHM_RING *ring, const char *data, size_t length, int socketId) {
+    size_t head = ring->head;
+    size_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (SHM_RING_SIZE - used < length) {
+        // The consumer may have made space in the meantime, so look again after announcing the wait
+        __atomic_store_n(&ring->producerWaiting, 1, __ATOMIC_SEQ_CST);
+        used = head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+        if (SHM_RING_SIZE - used < length) {
+            return 0;
+        }
+        __atomic_store_n(&ring->producerWaiting, 0, __ATOMIC_RELAXED);
+    }
+
+    size_t offset = head & SHM_RING_MASK;
+    size_t firstLength = SHM_RING_SIZE - offset < length ? SHM_RING_SIZE - offset : length;
+    memcpy(ring->data + offset, data, firstLength);
+    memcpy(ring->data, data + firstLength, length - firstLength);
+    __atomic_store_n(&ring->head, head + length, __ATOMIC_SEQ_CST);
+
+    // The consumer may only be asleep if it had read everything before this write.
+    // It is checked after publishing the data, otherwise the consumer could miss it without a doorbell.
+    if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head) {
+        ringDoorbell(socketId);
+    }
+    return 1;
+}
+
+//return the number of bytes still queued
+ssize_t flushSharedMemoryQueue(SHM_CHANNEL *channel, SEND_QUEUE *queue, int socketId) {
+    SEND_FRAME *frame;
+    while ((frame = peekSendFrame(queue)) != NULL) {
+        if (!writeSharedMemoryRing(&channel->toClient, frame->wire->data, frame->wire->length, socketId)) {
+            break;
+        }
+        freeSendFrame(dequeueSendFrame(queue));
+    }
+    return (ssize_t) queue->queuedBytes;
+}
+
+//return -1 if the client closed the socket
+int drainSharedMemoryDoorbell(int socketId) {
+    char doorbells[64];
+    while (1) {
+        ssize_t readSize = recv(socketId, doorbells, sizeof(doorbells), MSG_DONTWAIT);
+        if (readSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        } else if (readSize < 0 && errno == EINTR) {
+            continue;
+        } else if (readSize <= 0) {
+            return -1;
+        }
+    }
+}
+
+static SHM_CHANNEL *mapSharedMemoryChannel(int memoryFileDescriptor) {
+    // The size is only checked once, so the client must not be able to change it afterwards
+    int seals = fcntl(memoryFileDescriptor, F_GET_SEALS);
+    if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW)) {
+        errorPrint("Shared memory of local client is not sealed against resizing (F_SEAL_SHRINK, F_SEAL_GROW)!");
+        return NULL;
+    }
+
+    struct stat memoryStat;
+    if (fstat(memoryFileDescriptor, &memoryStat) < 0 || (size_t) memoryStat.st_size < sizeof(SHM_CHANNEL)) {
+        errorPrint("Shared memory of local client is too small!");
+        return NULL;
+    }
+
+    SHM_CHANNEL *channel = mmap(NULL, sizeof(SHM_CHANNEL), PROT_READ | PROT_WRITE, MAP_SHARED, memoryFileDescriptor, 0);
+    if (channel == MAP_FAILED) {
+        errnoPrint("Could not map shared memory of local client");
+        return NULL;
+    }
+    if (channel->magic != SHM_CHANNEL_MAGIC || channel->ringSize != SHM_RING_SIZE) {
+        errorPrint("Shared memory of local client has an unknown layout!");
+        munmap(channel, sizeof(SHM_CHANNEL));
+        return NULL;
+    }
+    return channel;
+}
+
+static void ringDoorbell(int socketId) {
+    // One pending doorbell is enough, so a full socket buffer does not matter
+    char doorbell = 1;
+    send(socketId, &doorbell, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
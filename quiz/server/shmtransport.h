@@ -0,0 +1,56 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * shmtransport.h: Header für den Shared-Memory-Transport lokaler Clients
+ *
+ * Ein lokaler Client (z.B. ein Bot) legt einen SHM_CHANNEL in einem memfd an,
+ * verbindet sich mit dem Unix-Socket des Servers und sendet als erstes Byte
+ * SHM_ATTACH_REQUEST, zusammen mit dem memfd (SCM_RIGHTS). Der memfd muss mit
+ * MFD_ALLOW_SEALING angelegt und nach dem ftruncate() mit F_SEAL_SHRINK und
+ * F_SEAL_GROW versiegelt sein, unversiegelte lehnt der Server ab. Danach werden die
+ * RFC-Nachrichten in beide Richtungen über die Ringe übertragen. Über den Socket
+ * wird nur noch je ein Byte als "Klingel" geschickt, wenn ein leerer Ring Daten
+ * erhält oder ein voller Ring wieder Platz hat.
+ */
+#ifndef SHMTRANSPORT_H
+#define SHMTRANSPORT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "sendqueue.h"
+
+#define SHM_CHANNEL_MAGIC 0x5155495A
+#define SHM_RING_SIZE (64 * 1024) // Must be a power of two
+#define SHM_ATTACH_REQUEST 0 // Not a RFC type, so a normal login request cannot be mistaken for it
+
+// A single producer single consumer ring, head and tail only grow and are written by one side each
+typedef struct {
+    size_t head __attribute__((aligned(64)));
+    size_t tail __attribute__((aligned(64)));
+    int producerWaiting __attribute__((aligned(64)));
+    char data[SHM_RING_SIZE] __attribute__((aligned(64)));
+} SHM_RING;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t ringSize;
+    SHM_RING toServer;
+    SHM_RING toClient;
+} SHM_CHANNEL;
+
+ssize_t receiveSharedMemoryAttach(int socketId, char *buffer, size_t length, SHM_CHANNEL **channel);
+
+void unmapSharedMemoryChannel(SHM_CHANNEL *channel);
+
+size_t readSharedMemoryRing(SHM_RING *ring, char *target, size_t length, int socketId);
+
+int writeSharedMemoryRing(SHM_RING *ring, const char *data, size_t length, int socketId);
+
+ssize_t flushSharedMemoryQueue(SHM_CHANNEL *channel, SEND_QUEUE *queue, int socketId);
+
+int drainSharedMemoryDoorbell(int socketId);
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * slottable.c: Implementierung der wachsenden Tabellen mit festen Adressen
+ *
+ * Die Tabelle hält nur die Zeiger auf ihre Blöcke. Ein Block wird beim ersten
+ * reserveSlot() in ihm angelegt und bleibt bis zum Programmende bestehen.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "slottable.h"
+#include "mutexhelper.h"
+#include "../common/util.h"
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+int initSlotTable(SLOT_TABLE *table, int capacity, size_t entrySize, /* nullable */ void (*initEntry)(void *entry)) {
+    if (mutexInit(&table->mutex, NULL) < 0) {
+        errorPrint("Could not init slot table MUTEX!");
+        return -1;
+    }
+
+    table->chunkCount = (capacity + SLOT_TABLE_CHUNK_SIZE - 1) / SLOT_TABLE_CHUNK_SIZE;
+    table->chunks = calloc((size_t) (table->chunkCount > 0 ? table->chunkCount : 1), sizeof(void *));
+    if (table->chunks == NULL) {
+        errorPrint("Could not allocate the slot table!");
+        return -2;
+    }
+    table->entrySize = entrySize;
+    table->initEntry = initEntry;
+    return 0;
+}
+
+int getSlotCapacity(SLOT_TABLE *table) {
+    return table->chunkCount * SLOT_TABLE_CHUNK_SIZE;
+}
+
+//return NULL if the chunk of the entry was never reserved
+void *getSlot(SLOT_TABLE *table, int index) {
+    if (index < 0 || index >= getSlotCapacity(table)) {
+        return NULL;
+    }
+    char *chunk = __atomic_load_n(&table->chunks[index / SLOT_TABLE_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+    return chunk != NULL ? chunk + (size_t) (index % SLOT_TABLE_CHUNK_SIZE) * table->entrySize : NULL;
+}
+
+//Allocates the chunk of the entry if needed, return NULL if the index is out of range or memory is short
+void *reserveSlot(SLOT_TABLE *table, int index) {
+    void *entry = getSlot(table, index);
+    if (entry != NULL || index < 0 || index >= getSlotCapacity(table)) {
+        return entry;
+    }
+
+    mutexLock(&table->mutex);
+    void **chunkPointer = &table->chunks[index / SLOT_TABLE_CHUNK_SIZE];
+    if (*chunkPointer == NULL) {
+        size_t chunkSize = SLOT_TABLE_CHUNK_SIZE * table->entrySize;
+        chunkSize = (chunkSize + SLOT_TABLE_CHUNK_ALIGNMENT - 1) / SLOT_TABLE_CHUNK_ALIGNMENT * SLOT_TABLE_CHUNK_ALIGNMENT;
+        void *chunkMemory = NULL;
+        if (posix_memalign(&chunkMemory, SLOT_TABLE_CHUNK_ALIGNMENT, chunkSize) == 0) {
+            memset(chunkMemory, 0, chunkSize);
+        }
+        char *chunk = chunkMemory;
+        if (chunk == NULL) {
+            errorPrint("Could not allocate a slot table chunk!");
+            mutexUnlock(&table->mutex);
+            return NULL;
+        }
+        for (int i = 0; table->initEntry != NULL && i < SLOT_TABLE_CHUNK_SIZE; i++) {
+            table->initEntry(chunk + (size_t) i * table->entrySize);
+        }
+        // Readers do not lock, they must see the initialized entries together with the pointer
+        __atomic_store_n(chunkPointer, chunk, __ATOMIC_RELEASE);
+    }
+    mutexUnlock(&table->mutex);
+    return getSlot(table, index);
+}
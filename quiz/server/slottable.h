@@ -0,0 +1,40 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * slottable.h: Header für wachsende Tabellen mit festen Adressen
+ *
+ * Eine Slot-Tabelle hat eine Kapazität, belegt aber nur Speicher für die
+ * Blöcke (je SLOT_TABLE_CHUNK_SIZE Einträge), die schon gebraucht wurden.
+ * Ein Eintrag wird nie verschoben, deshalb darf er auch ohne Lock gelesen
+ * werden, während die Tabelle wächst. Die Blöcke beginnen auf einer
+ * Cache-Line, damit Einträge mit ausgerichteten Feldern sie auch einhalten.
+ */
+#ifndef SLOTTABLE_H
+#define SLOTTABLE_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define SLOT_TABLE_CHUNK_SIZE 16
+#define SLOT_TABLE_CHUNK_ALIGNMENT 64
+
+typedef struct {
+    pthread_mutex_t mutex; // Only taken to allocate a chunk
+    void **chunks;
+    int chunkCount;
+    size_t entrySize;
+    void (*initEntry)(void *entry); // Called once for every entry of a new chunk
+} SLOT_TABLE;
+
+int initSlotTable(SLOT_TABLE *table, int capacity, size_t entrySize, /* nullable */ void (*initEntry)(void *entry));
+
+int getSlotCapacity(SLOT_TABLE *table);
+
+/* nullable */ void *getSlot(SLOT_TABLE *table, int index);
+
+/* nullable */ void *reserveSlot(SLOT_TABLE *table, int index);
+
+#endif
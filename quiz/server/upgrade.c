@@ -0,0 +1,402 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * upgrade.c: Implementierung des unterbrechungsfreien Updates des Servers
+ *
+ * Mit -H wartet der Server auf einem Unix-Socket auf einen Nachfolger. Ein neuer
+ * Server, der mit demselben Pfad gestartet wird, während das Lock-File existiert,
+ * verbindet sich dorthin, statt abzubrechen. Der alte Server übergibt ihm per
+ * SCM_RIGHTS seine Listen-Sockets, die wartenden Verbindungen, die laufenden
+ * Logins und die Spieler in der Lobby, jeweils mit den empfangenen, aber noch
+ * nicht behandelten und den noch nicht gesendeten Daten (ein HANDOFF_RECORD pro
+ * Socket). Der Kernel nimmt währenddessen weiter Verbindungen auf den
+ * Listen-Sockets an, der Port ist also nie geschlossen.
+ * Ein laufendes Spiel bleibt beim alten Server, der sich nach dessen Ende
+ * beendet. Was er bis dahin noch annimmt, gibt er ebenfalls weiter.
+ */
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "upgrade.h"
+#include "login.h"
+#include "receivebuffer.h"
+#include "mutexhelper.h"
+#include "threadholder.h"
+#include "vardefine.h"
+#include "../common/util.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+#define HANDOFF_TIMEOUT_SECONDS 5 // A predecessor stuck on a client must not keep the port from being served
+
+typedef struct {
+    int type;
+    int roomId; // A user keeps its room and seat, its id is given by the successor
+    int seat;
+    char name[USERNAMELENGTH];
+    uint32_t dataLength;
+    uint32_t unsentLength;
+} HANDOFF_RECORD;
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static int createUpgradeSocket(char *path);
+
+static void *waitForSuccessor(void *unused);
+
+static void *receiveLateHandOffs(void *unused);
+
+static int receiveHandOffs(int untilDone);
+
+static int receiveRecord(HANDOFF_RECORD *record, int *socket, char **data);
+
+static void adoptRecord(HANDOFF_RECORD *record, int socket, char *data);
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static int upgradeListenSocket = -1;
+static char *upgradeListenPath = NULL;
+
+static int successorSocket = -1;
+static pthread_mutex_t successorMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int predecessorSocket = -1;
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+//Waits in its own thread for a successor, the socket may have been taken over from the predecessor
+int startUpgradeListener(char *path) {
+    if (upgradeListenSocket < 0) {
+        upgradeListenSocket = createUpgradeSocket(path);
+        if (upgradeListenSocket < 0) {
+            return -1;
+        }
+        upgradeListenPath = path;
+    }
+
+    pthread_t threadId;
+    if (pthread_create(&threadId, NULL, waitForSuccessor, NULL) != 0) {
+        errorPrint("Error: Can't create upgrade thread");
+        return -2;
+    }
+    registerThread(threadId);
+    infoPrint("Waiting for a successor on %s", upgradeListenPath);
+    return 0;
+}
+
+//return 1 if the predecessor handed its sockets over, -1 if there is none or on error
+int takeOverPredecessor(char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errorPrint("Upgrade socket path is too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    predecessorSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (predecessorSocket < 0 || connect(predecessorSocket, (const struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        errnoPrint("Could not connect to the running server");
+        if (predecessorSocket >= 0) {
+            close(predecessorSocket);
+            predecessorSocket = -1;
+        }
+        return -1;
+    }
+    infoPrint("Taking over from the running server on %s...", path);
+
+    struct timeval timeout = {HANDOFF_TIMEOUT_SECONDS, 0};
+    setsockopt(predecessorSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int result = receiveHandOffs(1);
+    timeout.tv_sec = 0;
+    setsockopt(predecessorSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (result == -2) {
+        infoPrint("The running server did not hand over its lobby in time, starting anyway");
+    } else if (result < 0) {
+        // What was taken over so far stays, the rest is lost with the connection
+        errorPrint("Hand-over from the running server failed");
+        close(predecessorSocket);
+        predecessorSocket = -1;
+    }
+    return 1;
+}
+
+//Adopts what the predecessor accepts until it exits
+int startHandOffReceiver() {
+    if (predecessorSocket < 0) {
+        return 0;
+    }
+
+    pthread_t threadId;
+    if (pthread_create(&threadId, NULL, receiveLateHandOffs, NULL) != 0) {
+        errorPrint("Error: Can't create hand-over thread");
+        return -1;
+    }
+    registerThread(threadId);
+    return 0;
+}
+
+//Passes the socket with its data to the successor, the caller still has to close its own descriptor
+int handOffSocket(int type, int socket, int roomId, int seat, /* nullable */ const char *name, const char *data,
+                  size_t dataLength, const char *unsent, size_t unsentLength) {
+    HANDOFF_RECORD record;
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.roomId = roomId;
+    record.seat = seat;
+    if (name != NULL) {
+        strncpy(record.name, name, USERNAMELENGTH - 1);
+    }
+    record.dataLength = dataLength;
+    record.unsentLength = unsentLength;
+
+    struct iovec parts[3] = {{&record, sizeof(record)}, {(void *) data, dataLength}, {(void *) unsent, unsentLength}};
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = parts;
+    header.msg_iovlen = 3;
+    if (socket >= 0) {
+        header.msg_control = control.buffer;
+        header.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr *rights = CMSG_FIRSTHDR(&header);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(rights), &socket, sizeof(int));
+    }
+
+    mutexLock(&successorMutex);
+    ssize_t sendSize = successorSocket >= 0 ? sendmsg(successorSocket, &header, MSG_NOSIGNAL) : -1;
+    mutexUnlock(&successorMutex);
+    if (sendSize != (ssize_t) (sizeof(record) + dataLength + unsentLength)) {
+        errnoPrint("Could not hand a socket over to the successor");
+        return -1;
+    }
+    return 0;
+}
+
+void closeUpgradeSocket() {
+    // After an upgrade the socket belongs to the successor
+    if (upgradeListenSocket >= 0) {
+        close(upgradeListenSocket);
+        unlink(upgradeListenPath);
+        upgradeListenSocket = -1;
+    }
+}
+
+static int createUpgradeSocket(char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errorPrint("Upgrade socket path is too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenSocket < 0) {
+        errnoPrint("Could not create upgrade socket");
+        return -1;
+    }
+
+    // Whoever connects gets all sockets of the server, so only our own user may do so
+    unlink(path);
+    if (bind(listenSocket, (const struct sockaddr *) &addr, sizeof(addr)) < 0
+        || chmod(path, S_IRUSR | S_IWUSR) < 0 || listen(listenSocket, 1) < 0) {
+        errnoPrint("Could not listen on upgrade socket");
+        close(listenSocket);
+        unlink(path);
+        return -1;
+    }
+    return listenSocket;
+}
+
+static void *waitForSuccessor(void *unused) {
+    (void) unused;
+
+    int socket;
+    do {
+        socket = accept(upgradeListenSocket, NULL, NULL);
+    } while (socket < 0 && errno == EINTR);
+    if (socket < 0) {
+        errnoPrint("Could not accept successor");
+        return NULL;
+    }
+    infoPrint("A successor has connected, handing over...");
+
+    mutexLock(&successorMutex);
+    successorSocket = socket;
+    mutexUnlock(&successorMutex);
+
+    // The successor waits for the next upgrade on the same socket
+    handOffSocket(HANDOFF_UPGRADE_LISTENER, upgradeListenSocket, -1, -1, NULL, upgradeListenPath,
+                  strlen(upgradeListenPath) + 1, NULL, 0);
+    close(upgradeListenSocket);
+    upgradeListenSocket = -1;
+
+    retireLogin();
+    return NULL;
+}
+
+static void *receiveLateHandOffs(void *unused) {
+    (void) unused;
+
+    if (receiveHandOffs(0) < 0) {
+        errorPrint("Hand-over from the previous server failed");
+    } else {
+        infoPrint("The previous server has exited");
+    }
+    close(predecessorSocket);
+    predecessorSocket = -1;
+    return NULL;
+}
+
+//return 1 when the predecessor is done with its lobby, 0 when it has exited, -2 on timeout and -1 on error
+static int receiveHandOffs(int untilDone) {
+    while (1) {
+        HANDOFF_RECORD record;
+        int socket = -1;
+        char *data = NULL;
+        int type = receiveRecord(&record, &socket, &data);
+        if (type <= 0) {
+            return type;
+        }
+
+        if (type == HANDOFF_DONE) {
+            infoPrint("The previous server has handed over its lobby");
+            if (socket >= 0) {
+                close(socket);
+            }
+            if (untilDone) {
+                free(data);
+                return 1;
+            }
+        } else {
+            adoptRecord(&record, socket, data);
+        }
+        free(data);
+    }
+}
+
+//return the record type, 0 at the end of the stream, -2 on timeout and -1 on error. The data has to be freed
+static int receiveRecord(HANDOFF_RECORD *record, int *socket, char **data) {
+    struct iovec part = {record, sizeof(*record)};
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = &part;
+    header.msg_iovlen = 1;
+    header.msg_control = control.buffer;
+    header.msg_controllen = sizeof(control.buffer);
+
+    ssize_t readSize;
+    do {
+        readSize = recvmsg(predecessorSocket, &header, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    } while (readSize < 0 && errno == EINTR);
+    if (readSize == 0) {
+        return 0;
+    }
+    if (readSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return -2;
+    }
+
+    // A record brings at most one socket, every further one is closed so it does not leak
+    for (struct cmsghdr *rights = CMSG_FIRSTHDR(&header); rights != NULL; rights = CMSG_NXTHDR(&header, rights)) {
+        if (rights->cmsg_level != SOL_SOCKET || rights->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t rightsCount = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < rightsCount; i++) {
+            int passed;
+            memcpy(&passed, CMSG_DATA(rights) + i * sizeof(int), sizeof(int));
+            if (*socket < 0) {
+                *socket = passed;
+            } else {
+                close(passed);
+            }
+        }
+    }
+    if (readSize != sizeof(*record) || (header.msg_flags & MSG_CTRUNC) || record->dataLength > RECEIVE_BUFFER_SIZE
+        || record->unsentLength > MAXSENDQUEUEBYTES) {
+        errorPrint("Received a broken hand-over record");
+        if (*socket >= 0) {
+            close(*socket);
+        }
+        return -1;
+    }
+
+    size_t length = record->dataLength + record->unsentLength;
+    *data = malloc(length + 1);
+    if (*data == NULL || (length > 0 && recv(predecessorSocket, *data, length, MSG_WAITALL) != (ssize_t) length)) {
+        errnoPrint("Could not receive hand-over data");
+        if (*socket >= 0) {
+            close(*socket);
+        }
+        return -1;
+    }
+    (*data)[length] = '\0';
+    return record->type;
+}
+
+static void adoptRecord(HANDOFF_RECORD *record, int socket, char *data) {
+    if (socket < 0) {
+        errorPrint("Hand-over record %d comes without a socket", record->type);
+        return;
+    }
+
+    switch (record->type) {
+        case HANDOFF_LISTENER:
+            inheritListenSocket(socket, NULL);
+            break;
+        case HANDOFF_LOCAL_LISTENER:
+            inheritListenSocket(socket, strdup(data));
+            break;
+        case HANDOFF_UPGRADE_LISTENER:
+            upgradeListenSocket = socket;
+            upgradeListenPath = strdup(data);
+            break;
+        case HANDOFF_WAITING:
+            adoptWaitingConnection(socket);
+            break;
+        case HANDOFF_HANDSHAKE:
+            adoptHandshake(socket, data, record->dataLength);
+            break;
+        case HANDOFF_USER: {
+            RECEIVE_BUFFER received;
+            initReceiveBuffer(&received);
+            appendReceiveBuffer(&received, data, record->dataLength);
+            record->name[USERNAMELENGTH - 1] = '\0';
+            adoptLobbyUser(socket, record->roomId, record->seat, record->name, &received, data + record->dataLength,
+                           record->unsentLength);
+            break;
+        }
+        default:
+            errorPrint("Unknown hand-over record %d", record->type);
+            close(socket);
+            break;
+    }
+}
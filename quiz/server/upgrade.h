@@ -0,0 +1,35 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * upgrade.h: Header für das unterbrechungsfreie Update des Servers
+ */
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <sys/types.h>
+
+enum {
+    HANDOFF_LISTENER = 1, // A TCP listen socket
+    HANDOFF_LOCAL_LISTENER = 2, // The unix listen socket, the data is its path
+    HANDOFF_UPGRADE_LISTENER = 3, // The socket the next successor connects to, the data is its path
+    HANDOFF_WAITING = 4, // A connection waiting for a free slot
+    HANDOFF_HANDSHAKE = 5, // A running login, the data is what was received so far
+    HANDOFF_USER = 6, // A lobby user with the data not handled yet, followed by the data not sent yet
+    HANDOFF_DONE = 7 // No lobby user is left at the predecessor, the successor may accept now
+};
+
+int startUpgradeListener(char *path);
+
+int takeOverPredecessor(char *path);
+
+int startHandOffReceiver();
+
+int handOffSocket(int type, int socket, int roomId, int seat, /* nullable */ const char *name, const char *data,
+                  size_t dataLength, const char *unsent, size_t unsentLength);
+
+void closeUpgradeSocket();
+
+#endif
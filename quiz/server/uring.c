@@ -0,0 +1,935 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * uring.c: Implementierung des io_uring-Backends des Reactors
+ *
+ * Dieses Backend ersetzt die einzelnen recv(2)- und send(2)-Aufrufe pro Nachricht
+ * durch Aufträge an einen io_uring, die gesammelt mit einem io_uring_enter(2)
+ * abgeschickt werden. Jeder Reactor besitzt einen eigenen Ring:
+ *  - Auf dem Listen-Socket des Reactors läuft ein Multishot-Accept.
+ *  - Sockets im Login werden nur mit einem Poll beobachtet, gelesen wird der
+ *    Login-Request vom Login-Modul selbst.
+ *  - Pro Client-Socket läuft ein einziger Multishot-Receive, der die Daten in
+ *    vom Server bereitgestellte Puffer (Buffer-Group) schreibt. Aus den Daten
+ *    werden die RFC-Nachrichten zusammengesetzt und an den Reactor-Callback
+ *    übergeben.
+ *  - Sendeaufträge werden pro Socket gesammelt und als verkettete (IOSQE_IO_LINK)
+ *    Sends abgeschickt, damit die Reihenfolge erhalten bleibt. Aufträge aus dem
+ *    Reactor-Thread selbst werden erst mit dem nächsten Warten auf Ereignisse
+ *    übermittelt, sodass eine Frage-Runde nur einen Systemaufruf kostet.
+ * Das Backend verwendet die Systemaufrufe direkt und benötigt keine liburing.
+ */
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "../common/util.h"
+#include "uring.h"
+#include "rfc.h"
+#include "mutexhelper.h"
+#include "receivebuffer.h"
+#include "sendqueue.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+#define URING_ENTRIES 256
+#define URING_BUFFER_GROUP 1
+#define URING_BUFFER_COUNT 256
+#define URING_BUFFER_SIZE 2048
+#define URING_MAX_CONNECTIONS (1 << 20)
+#define URING_DRAIN_TIMEOUT_MILLIS 1000
+
+// The lower three bits of the user data tell the kind of the request, the rest may be a pointer
+enum {
+    URING_TAG_SEND = 0,
+    URING_TAG_RECEIVE = 1,
+    URING_TAG_PROVIDE_BUFFER = 2,
+    URING_TAG_CANCEL = 3,
+    URING_TAG_ACCEPT = 4,
+    URING_TAG_POLL = 5
+};
+#define URING_TAG_MASK 7
+
+typedef struct {
+    int ringFileDescriptor;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqRingMask;
+    unsigned *sqRingEntries;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqRingMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned unsubmitted;
+    pthread_mutex_t mutex;
+    pthread_t threadId;
+    char *receiveBuffers;
+    REACTOR_ACCEPT_CALLBACK onAccept;
+    int sendsInFlight;
+} URING;
+
+// A handshake poll carries its socket and generation, so outdated polls of a reused socket are detected
+typedef struct {
+    unsigned generation;
+    int watched;
+    REACTOR_HANDSHAKE_CALLBACK onHandshake;
+} URING_HANDSHAKE;
+
+typedef struct uring_connection {
+    URING *ring;
+    int clientSocket;
+    int userId;
+    int active;
+    int receiving;
+    RECEIVE_BUFFER received;
+    SEND_QUEUE sendQueue;
+    int sendsInFlight;
+    size_t bytesInFlight;
+    int tooSlow;
+    REACTOR_RELEASE_CALLBACK releaseCallback;
+    int released;
+} URING_CONNECTION;
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static int setupRing(URING *ring, unsigned entries);
+
+static void handleCompletion(URING *ring, struct io_uring_cqe *cqe);
+
+static void handleAcceptCompletion(URING *ring, struct io_uring_cqe *cqe);
+
+static void handleReceiveCompletion(URING_CONNECTION *connection, struct io_uring_cqe *cqe);
+
+static void handleSendCompletion(SEND_FRAME *frame, int result);
+
+static void handlePollCompletion(URING *ring, struct io_uring_cqe *cqe);
+
+static int handleReceivedData(URING_CONNECTION *connection, const char *data, size_t length);
+
+static struct io_uring_sqe *getSqe(URING *ring);
+
+static unsigned getFreeSqeCount(URING *ring);
+
+static int submitPending(URING *ring);
+
+static int isLoopThread(URING *ring);
+
+static void queueAccept(URING *ring, int listenSocket);
+
+static void queueReceive(URING_CONNECTION *connection);
+
+static void queuePoll(URING *ring, int clientSocket);
+
+static uint64_t packPollData(int clientSocket, unsigned generation);
+
+static void queueProvideBuffers(URING *ring, int bufferId, int count);
+
+static void queueSendChain(URING_CONNECTION *connection);
+
+static void releaseConnectionIfUnused(URING_CONNECTION *connection);
+
+static int takeFinishedRelease(URING_CONNECTION *connection);
+
+static void finishRelease(URING_CONNECTION *connection);
+
+static int ioUringSetup(unsigned entries, struct io_uring_params *params);
+
+static int ioUringEnter(URING *ring, unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static URING *rings = NULL;
+static int ringCount = 0;
+
+// Every slot is only written by the ring owning the socket (under the mutex of that ring)
+static URING_CONNECTION **connections = NULL;
+static int connectionCapacity = 0;
+
+// Indexed by socket like the connections, written by the ring owning the socket
+static URING_HANDSHAKE *handshakes = NULL;
+
+static REACTOR_MESSAGE_CALLBACK onMessage = NULL;
+
+static REACTOR_DISCONNECT_CALLBACK onDisconnect = NULL;
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+int initUringReactors(int count, REACTOR_MESSAGE_CALLBACK messageCallback,
+                      REACTOR_DISCONNECT_CALLBACK disconnectCallback) {
+    onMessage = messageCallback;
+    onDisconnect = disconnectCallback;
+
+    // The connections are looked up by their socket, so we need a slot for every possible descriptor
+    struct rlimit fileLimit;
+    if (getrlimit(RLIMIT_NOFILE, &fileLimit) < 0) {
+        errnoPrint("Could not get the file descriptor limit");
+        return -1;
+    }
+    connectionCapacity = fileLimit.rlim_cur < URING_MAX_CONNECTIONS
+                         ? (int) fileLimit.rlim_cur
+                         : URING_MAX_CONNECTIONS;
+    connections = calloc((size_t) connectionCapacity, sizeof(URING_CONNECTION *));
+    handshakes = calloc((size_t) connectionCapacity, sizeof(URING_HANDSHAKE));
+    rings = calloc((size_t) count, sizeof(URING));
+    if (connections == NULL || handshakes == NULL || rings == NULL) {
+        errorPrint("Could not allocate io_uring reactors!");
+        return -2;
+    }
+    ringCount = count;
+
+    for (int i = 0; i < ringCount; i++) {
+        URING *ring = &rings[i];
+        if (mutexInit(&ring->mutex, NULL) < 0) {
+            errorPrint("Could not init io_uring MUTEX!");
+            return -3;
+        }
+        ring->receiveBuffers = malloc(URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+        if (ring->receiveBuffers == NULL) {
+            errorPrint("Could not allocate io_uring receive buffers!");
+            return -4;
+        }
+        if (setupRing(ring, URING_ENTRIES) < 0) {
+            errorPrint("Could not set up io_uring (kernel too old or io_uring disabled?)");
+            return -5;
+        }
+
+        // Hand all receive buffers to the kernel at once
+        mutexLock(&ring->mutex);
+        queueProvideBuffers(ring, 0, URING_BUFFER_COUNT);
+        int submitResult = submitPending(ring);
+        mutexUnlock(&ring->mutex);
+        if (submitResult < 0) {
+            errnoPrint("Could not provide receive buffers to io_uring");
+            return -6;
+        }
+    }
+    return 0;
+}
+
+void runUringReactor(int reactorIndex) {
+    URING *ring = &rings[reactorIndex];
+    mutexLock(&ring->mutex);
+    ring->threadId = pthread_self();
+    mutexUnlock(&ring->mutex);
+
+    while (1) {
+        // Everything queued by the handlers since the last round is submitted under the mutex. Another thread
+        // that submitted in between would take these entries and could split a linked send chain.
+        mutexLock(&ring->mutex);
+        int submitResult = submitPending(ring);
+        mutexUnlock(&ring->mutex);
+        if (submitResult < 0 && errno != EINTR) {
+            errnoPrint("io_uring reactor could not submit its entries");
+        }
+
+        if (ioUringEnter(ring, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            errnoPrint("io_uring reactor could not wait for completions");
+            return;
+        }
+
+        unsigned head = *ring->cqHead;
+        while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+            // Copy the completion and release its slot before handling, the handlers may take long
+            struct io_uring_cqe cqe = ring->cqes[head & *ring->cqRingMask];
+            head++;
+            __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+            handleCompletion(ring, &cqe);
+        }
+    }
+}
+
+int uringAddListener(int reactorIndex, int listenSocket, REACTOR_ACCEPT_CALLBACK acceptCallback) {
+    URING *ring = &rings[reactorIndex];
+
+    mutexLock(&ring->mutex);
+    ring->onAccept = acceptCallback;
+    queueAccept(ring, listenSocket);
+    int result = isLoopThread(ring) ? 0 : submitPending(ring);
+    mutexUnlock(&ring->mutex);
+
+    if (result < 0) {
+        errnoPrint("Could not submit multishot accept");
+        return -1;
+    }
+    return 0;
+}
+
+int uringRemoveListener(int listenSocket) {
+    // The multishot accept holds its own reference on the socket, so it is cancelled on every ring
+    for (int i = 0; i < ringCount; i++) {
+        URING *ring = &rings[i];
+        mutexLock(&ring->mutex);
+        struct io_uring_sqe *sqe = getSqe(ring);
+        if (sqe != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = (uint64_t) listenSocket << 3 | URING_TAG_ACCEPT;
+            sqe->user_data = URING_TAG_CANCEL;
+        }
+        if (!isLoopThread(ring)) {
+            submitPending(ring);
+        }
+        mutexUnlock(&ring->mutex);
+    }
+    return 0;
+}
+
+int uringAddHandshake(int reactorIndex, int clientSocket, REACTOR_HANDSHAKE_CALLBACK handshakeCallback) {
+    if (clientSocket < 0 || clientSocket >= connectionCapacity) {
+        errorPrint("Socket %d exceeds the io_uring handshake table!", clientSocket);
+        return -1;
+    }
+
+    URING *ring = &rings[reactorIndex];
+    mutexLock(&ring->mutex);
+    URING_HANDSHAKE *handshake = &handshakes[clientSocket];
+    handshake->generation++;
+    handshake->watched = 1;
+    handshake->onHandshake = handshakeCallback;
+    queuePoll(ring, clientSocket);
+    if (!isLoopThread(ring)) {
+        submitPending(ring);
+    }
+    mutexUnlock(&ring->mutex);
+    return 0;
+}
+
+int uringRemoveHandshake(int reactorIndex, int clientSocket) {
+    if (clientSocket < 0 || clientSocket >= connectionCapacity) {
+        return -1;
+    }
+
+    URING *ring = &rings[reactorIndex];
+    mutexLock(&ring->mutex);
+    URING_HANDSHAKE *handshake = &handshakes[clientSocket];
+    if (!handshake->watched) {
+        mutexUnlock(&ring->mutex);
+        return -1;
+    }
+    handshake->watched = 0;
+
+    // A pending poll would hold a reference on the socket, so it has to be removed
+    struct io_uring_sqe *sqe = getSqe(ring);
+    if (sqe != NULL) {
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = packPollData(clientSocket, handshake->generation);
+        sqe->user_data = URING_TAG_CANCEL;
+    }
+    handshake->generation++;
+    if (!isLoopThread(ring)) {
+        submitPending(ring);
+    }
+    mutexUnlock(&ring->mutex);
+    return 0;
+}
+
+int uringAddClient(int reactorIndex, int clientSocket, int userId, /* nullable */ RECEIVE_BUFFER *received) {
+    if (clientSocket < 0 || clientSocket >= connectionCapacity) {
+        errorPrint("Socket %d exceeds the io_uring connection table!", clientSocket);
+        return -1;
+    }
+
+    URING_CONNECTION *connection = calloc(1, sizeof(URING_CONNECTION));
+    if (connection == NULL) {
+        errorPrint("Could not allocate io_uring connection for user %d!", userId);
+        return -2;
+    }
+    URING *ring = &rings[reactorIndex];
+    connection->ring = ring;
+    connection->clientSocket = clientSocket;
+    connection->userId = userId;
+    connection->active = 1;
+    if (received != NULL) {
+        connection->received = *received;
+    } else {
+        initReceiveBuffer(&connection->received);
+    }
+
+    mutexLock(&ring->mutex);
+    connections[clientSocket] = connection;
+    queueReceive(connection);
+    if (!isLoopThread(ring)) {
+        submitPending(ring);
+    }
+    mutexUnlock(&ring->mutex);
+
+    debugPrint("io_uring %d receives on socket %d of user %d", reactorIndex, clientSocket, userId);
+    return 0;
+}
+
+int uringRemoveClient(int reactorIndex, int clientSocket) {
+    if (clientSocket < 0 || clientSocket >= connectionCapacity) {
+        return -1;
+    }
+
+    URING *ring = &rings[reactorIndex];
+    mutexLock(&ring->mutex);
+    URING_CONNECTION *connection = connections[clientSocket];
+    if (connection == NULL || connection->ring != ring) {
+        mutexUnlock(&ring->mutex);
+        debugPrint("Socket %d was not watched by io_uring %d (anymore)", clientSocket, reactorIndex);
+        return -1;
+    }
+    connections[clientSocket] = NULL;
+    connection->active = 0;
+
+    // Sends that were not submitted yet will never be sent
+    clearSendQueue(&connection->sendQueue);
+
+    // The multishot receive holds its own reference on the socket, so it has to be cancelled
+    if (connection->receiving) {
+        struct io_uring_sqe *sqe = getSqe(ring);
+        if (sqe != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = (uint64_t) (uintptr_t) connection | URING_TAG_RECEIVE;
+            sqe->user_data = URING_TAG_CANCEL;
+        }
+    }
+    releaseConnectionIfUnused(connection);
+    if (!isLoopThread(ring)) {
+        submitPending(ring);
+    }
+    mutexUnlock(&ring->mutex);
+    return 0;
+}
+
+int uringReleaseClient(int reactorIndex, int clientSocket, REACTOR_RELEASE_CALLBACK releaseCallback) {
+    if (clientSocket < 0 || clientSocket >= connectionCapacity) {
+        return -1;
+    }
+
+    URING *ring = &rings[reactorIndex];
+    mutexLock(&ring->mutex);
+    URING_CONNECTION *connection = connections[clientSocket];
+    if (connection == NULL || connection->ring != ring || connection->releaseCallback != NULL) {
+        mutexUnlock(&ring->mutex);
+        return -1;
+    }
+    connection->releaseCallback = releaseCallback;
+
+    // The socket is passed on once the receive is cancelled and the kernel has sent what is in flight
+    if (connection->receiving) {
+        struct io_uring_sqe *sqe = getSqe(ring);
+        if (sqe != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = (uint64_t) (uintptr_t) connection | URING_TAG_RECEIVE;
+            sqe->user_data = URING_TAG_CANCEL;
+        }
+    }
+    int finished = takeFinishedRelease(connection);
+    if (!isLoopThread(ring)) {
+        submitPending(ring);
+    }
+    mutexUnlock(&ring->mutex);
+
+    if (finished) {
+        finishRelease(connection);
+    }
+    return 0;
+}
+
+ssize_t uringSend(int reactorIndex, int clientSocket, WIRE_FRAME *wire) {
+    URING *ring = &rings[reactorIndex];
+
+    mutexLock(&ring->mutex);
+    URING_CONNECTION *connection = connections[clientSocket];
+    if (connection == NULL || connection->ring != ring) {
+        // Sockets that are not handled by this ring (yet) are written directly
+        mutexUnlock(&ring->mutex);
+        return send(clientSocket, wire->data, wire->length, MSG_NOSIGNAL);
+    }
+
+    if (connection->tooSlow) {
+        // Already shut down, the disconnect is on its way
+        mutexUnlock(&ring->mutex);
+        return -1;
+    }
+
+    // While nothing is queued or in flight, the socket buffer usually takes the message right away.
+    // Otherwise a client sending many requests at once could fill its queue faster than the ring sends it.
+    ssize_t sendSize = 0;
+    if (isSendQueueEmpty(&connection->sendQueue) && connection->sendsInFlight == 0
+        && connection->releaseCallback == NULL) {
+        sendSize = send(clientSocket, wire->data, wire->length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sendSize == (ssize_t) wire->length) {
+            mutexUnlock(&ring->mutex);
+            return sendSize;
+        } else if (sendSize < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            mutexUnlock(&ring->mutex);
+            return -1;
+        } else if (sendSize < 0) {
+            sendSize = 0;
+        }
+    }
+
+    // The reference keeps the frame alive until the kernel has sent it
+    SEND_FRAME *frame = createSendFrame(wire, (size_t) sendSize);
+    if (frame == NULL) {
+        mutexUnlock(&ring->mutex);
+        errorPrint("Could not allocate io_uring send request!");
+        return -1;
+    }
+    frame->owner = connection;
+
+    // The sends in flight count as well, the kernel has not sent them yet
+    if (enqueueSendFrame(&connection->sendQueue, frame, connection->bytesInFlight) < 0) {
+        // The multishot receive notices the shutdown and disconnects the client as usual
+        connection->tooSlow = 1;
+        mutexUnlock(&ring->mutex);
+        errorPrint("Client on socket %d is too slow, disconnecting", clientSocket);
+        shutdown(clientSocket, SHUT_RDWR);
+        return -1;
+    }
+
+    // Only one chain per socket may be in flight, otherwise the order could get mixed up.
+    // A released socket only collects the messages for its new owner.
+    if (connection->sendsInFlight == 0 && connection->releaseCallback == NULL) {
+        queueSendChain(connection);
+    }
+    if (!isLoopThread(ring)) {
+        submitPending(ring);
+    }
+    mutexUnlock(&ring->mutex);
+
+    return (ssize_t) wire->length;
+}
+
+void uringDrain() {
+    // Submit what the reactor threads have queued and give the kernel some time to send it
+    for (int i = 0; i < ringCount; i++) {
+        mutexLock(&rings[i].mutex);
+        submitPending(&rings[i]);
+        mutexUnlock(&rings[i].mutex);
+    }
+
+    for (int waited = 0; waited < URING_DRAIN_TIMEOUT_MILLIS; waited += 10) {
+        int sendsLeft = 0;
+        for (int i = 0; i < ringCount; i++) {
+            mutexLock(&rings[i].mutex);
+            sendsLeft += rings[i].sendsInFlight;
+            mutexUnlock(&rings[i].mutex);
+        }
+        if (sendsLeft == 0) {
+            return;
+        }
+        usleep(10 * 1000);
+    }
+    errorPrint("io_uring could not send all messages before shutdown!");
+}
+
+static int setupRing(URING *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    ring->ringFileDescriptor = ioUringSetup(entries, &params);
+    if (ring->ringFileDescriptor < 0) {
+        errnoPrint("io_uring_setup");
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        errorPrint("io_uring does not support single mmap of the rings!");
+        return -2;
+    }
+
+    size_t sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ringSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+
+    char *mappedRings = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->ringFileDescriptor, IORING_OFF_SQ_RING);
+    if (mappedRings == MAP_FAILED) {
+        errnoPrint("Could not map io_uring rings");
+        return -3;
+    }
+    ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->ringFileDescriptor, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        errnoPrint("Could not map io_uring submission entries");
+        return -4;
+    }
+
+    ring->sqHead = (unsigned *) (mappedRings + params.sq_off.head);
+    ring->sqTail = (unsigned *) (mappedRings + params.sq_off.tail);
+    ring->sqRingMask = (unsigned *) (mappedRings + params.sq_off.ring_mask);
+    ring->sqRingEntries = (unsigned *) (mappedRings + params.sq_off.ring_entries);
+    ring->sqArray = (unsigned *) (mappedRings + params.sq_off.array);
+    ring->cqHead = (unsigned *) (mappedRings + params.cq_off.head);
+    ring->cqTail = (unsigned *) (mappedRings + params.cq_off.tail);
+    ring->cqRingMask = (unsigned *) (mappedRings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (mappedRings + params.cq_off.cqes);
+    ring->unsubmitted = 0;
+    return 0;
+}
+
+static void handleCompletion(URING *ring, struct io_uring_cqe *cqe) {
+    uint64_t tag = cqe->user_data & URING_TAG_MASK;
+    void *pointer = (void *) (uintptr_t) (cqe->user_data & ~(uint64_t) URING_TAG_MASK);
+
+    switch (tag) {
+        case URING_TAG_ACCEPT:
+            handleAcceptCompletion(ring, cqe);
+            break;
+        case URING_TAG_RECEIVE:
+            handleReceiveCompletion(pointer, cqe);
+            break;
+        case URING_TAG_SEND:
+            handleSendCompletion(pointer, cqe->res);
+            break;
+        case URING_TAG_POLL:
+            handlePollCompletion(ring, cqe);
+            break;
+        case URING_TAG_PROVIDE_BUFFER:
+            if (cqe->res < 0) {
+                errorPrint("io_uring could not take back a receive buffer (%d)!", cqe->res);
+            }
+            break;
+        default:
+            // Result of a cancellation, nothing to do
+            break;
+    }
+}
+
+static void handleAcceptCompletion(URING *ring, struct io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        ring->onAccept(cqe->res);
+    } else if (cqe->res != -EINTR && cqe->res != -EAGAIN) {
+        errorPrint("io_uring could not accept client connection (%d)", cqe->res);
+    }
+
+    // The kernel may stop the multishot accept (e.g. on errors), so start a new one
+    if (!(cqe->flags & IORING_CQE_F_MORE) && cqe->res != -EBADF && cqe->res != -ECANCELED) {
+        mutexLock(&ring->mutex);
+        queueAccept(ring, (int) (cqe->user_data >> 3));
+        mutexUnlock(&ring->mutex);
+    }
+}
+
+static void handleReceiveCompletion(URING_CONNECTION *connection, struct io_uring_cqe *cqe) {
+    URING *ring = connection->ring;
+    int hasMore = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    int protocolError = 0;
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        int bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        char *data = ring->receiveBuffers + (size_t) bufferId * URING_BUFFER_SIZE;
+        if (cqe->res > 0 && connection->active) {
+            protocolError = handleReceivedData(connection, data, (size_t) cqe->res) < 0;
+        }
+
+        // The data has been consumed, so the buffer can be used for the next receive
+        mutexLock(&ring->mutex);
+        queueProvideBuffers(ring, bufferId, 1);
+        mutexUnlock(&ring->mutex);
+    }
+
+    if (hasMore && !protocolError) {
+        return;
+    }
+
+    mutexLock(&ring->mutex);
+    int active = connection->active;
+    int releasing = connection->releaseCallback != NULL;
+    int rearm = active && !releasing && !protocolError && (cqe->res > 0 || cqe->res == -ENOBUFS);
+    if (rearm) {
+        // The kernel stopped the multishot receive (e.g. no free buffers), so start a new one
+        queueReceive(connection);
+    }
+    mutexUnlock(&ring->mutex);
+
+    if (active && releasing && protocolError) {
+        // The new owner notices the broken stream and disconnects the client
+        shutdown(connection->clientSocket, SHUT_RDWR);
+    } else if (active && !rearm && !releasing) {
+        // End of stream, receive error or a malformed message: the client is gone
+        debugPrint("io_uring receive on socket %d ended (%d)", connection->clientSocket, cqe->res);
+        onDisconnect(connection->userId);
+    }
+
+    // Only now the connection may be released, the disconnect callback still needs it
+    mutexLock(&ring->mutex);
+    if (!rearm) {
+        connection->receiving = hasMore;
+    }
+    int finished = takeFinishedRelease(connection);
+    releaseConnectionIfUnused(connection);
+    mutexUnlock(&ring->mutex);
+
+    if (finished) {
+        finishRelease(connection);
+    }
+}
+
+static void handleSendCompletion(SEND_FRAME *frame, int result) {
+    URING_CONNECTION *connection = frame->owner;
+    URING *ring = connection->ring;
+
+    mutexLock(&ring->mutex);
+    size_t length = frame->wire->length - frame->sent;
+    if (result != (int) length && connection->active && !connection->tooSlow) {
+        errorPrint("io_uring send on socket %d failed (%d of %zu bytes)", connection->clientSocket, result, length);
+    }
+    connection->bytesInFlight -= length;
+    freeSendFrame(frame);
+
+    connection->sendsInFlight--;
+    ring->sendsInFlight--;
+    if (connection->sendsInFlight == 0 && !isSendQueueEmpty(&connection->sendQueue)
+        && connection->releaseCallback == NULL) {
+        queueSendChain(connection);
+    }
+    int finished = takeFinishedRelease(connection);
+    releaseConnectionIfUnused(connection);
+    mutexUnlock(&ring->mutex);
+
+    if (finished) {
+        finishRelease(connection);
+    }
+}
+
+static void handlePollCompletion(URING *ring, struct io_uring_cqe *cqe) {
+    int clientSocket = (int) ((cqe->user_data & 0xFFFFFFFF) >> 3);
+    unsigned generation = (unsigned) (cqe->user_data >> 32);
+    URING_HANDSHAKE *handshake = &handshakes[clientSocket];
+
+    mutexLock(&ring->mutex);
+    int current = handshake->watched && handshake->generation == generation;
+    REACTOR_HANDSHAKE_CALLBACK handshakeCallback = handshake->onHandshake;
+    mutexUnlock(&ring->mutex);
+    if (!current || cqe->res == -ECANCELED) {
+        return;
+    }
+
+    // The poll is one-shot, so it is armed again as long as the login still waits for data
+    if (handshakeCallback(clientSocket) > 0) {
+        mutexLock(&ring->mutex);
+        if (handshake->watched && handshake->generation == generation) {
+            queuePoll(ring, clientSocket);
+        }
+        mutexUnlock(&ring->mutex);
+    }
+}
+
+static int handleReceivedData(URING_CONNECTION *connection, const char *data, size_t length) {
+    while (length > 0) {
+        size_t appended = appendReceiveBuffer(&connection->received, data, length);
+        data += appended;
+        length -= appended;
+
+        // A released connection keeps its messages for the new owner, they have to fit the buffer
+        if (connection->releaseCallback != NULL) {
+            if (length > 0) {
+                errorPrint("Receive buffer of released socket %d overflowed!", connection->clientSocket);
+                return -1;
+            }
+            return 0;
+        }
+
+        // Hand over every complete message, a partial one stays in the buffer for the next receive
+        while (1) {
+            MESSAGE message;
+            ssize_t consumed = nextReceivedMessage(&connection->received, &message);
+            if (consumed == 0) {
+                break;
+            } else if (consumed < 0) {
+                errorPrint("Received malformed message on socket %d!", connection->clientSocket);
+                return -1;
+            }
+
+            if (!connection->active) {
+                return 0;
+            }
+            onMessage(connection->userId, &message);
+        }
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *getSqe(URING *ring) {
+    if (getFreeSqeCount(ring) == 0) {
+        // The submission queue is full, hand it over to the kernel first
+        if (submitPending(ring) < 0) {
+            errnoPrint("Could not flush full io_uring submission queue");
+            return NULL;
+        }
+    }
+
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqRingMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+    return sqe;
+}
+
+static unsigned getFreeSqeCount(URING *ring) {
+    return *ring->sqRingEntries - (*ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE));
+}
+
+static int submitPending(URING *ring) {
+    if (ring->unsubmitted == 0) {
+        return 0;
+    }
+    int result = ioUringEnter(ring, ring->unsubmitted, 0, 0);
+    if (result >= 0) {
+        ring->unsubmitted = 0;
+    }
+    return result;
+}
+
+static int isLoopThread(URING *ring) {
+    return pthread_equal(pthread_self(), ring->threadId);
+}
+
+static void queueAccept(URING *ring, int listenSocket) {
+    struct io_uring_sqe *sqe = getSqe(ring);
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    // A ring may accept on several listen sockets, the socket is needed to start the accept again
+    sqe->user_data = (uint64_t) listenSocket << 3 | URING_TAG_ACCEPT;
+}
+
+static void queueReceive(URING_CONNECTION *connection) {
+    struct io_uring_sqe *sqe = getSqe(connection->ring);
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->clientSocket;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = (uint64_t) (uintptr_t) connection | URING_TAG_RECEIVE;
+    connection->receiving = 1;
+}
+
+static void queuePoll(URING *ring, int clientSocket) {
+    struct io_uring_sqe *sqe = getSqe(ring);
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = clientSocket;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = packPollData(clientSocket, handshakes[clientSocket].generation);
+}
+
+static uint64_t packPollData(int clientSocket, unsigned generation) {
+    return ((uint64_t) generation << 32) | ((uint64_t) (uint32_t) clientSocket << 3) | URING_TAG_POLL;
+}
+
+static void queueProvideBuffers(URING *ring, int bufferId, int count) {
+    struct io_uring_sqe *sqe = getSqe(ring);
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = count;
+    sqe->addr = (uint64_t) (uintptr_t) (ring->receiveBuffers + (size_t) bufferId * URING_BUFFER_SIZE);
+    sqe->len = URING_BUFFER_SIZE;
+    sqe->off = (uint64_t) bufferId;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = URING_TAG_PROVIDE_BUFFER;
+}
+
+static void queueSendChain(URING_CONNECTION *connection) {
+    URING *ring = connection->ring;
+
+    // A chain must not be split over two submissions, so it is limited to the free entries.
+    // The remaining sends stay queued until this chain is completed.
+    unsigned freeEntries = getFreeSqeCount(ring);
+    if (freeEntries == 0 && submitPending(ring) >= 0) {
+        freeEntries = getFreeSqeCount(ring);
+    }
+
+    // The queued sends of the socket are submitted as one linked chain
+    while (!isSendQueueEmpty(&connection->sendQueue) && freeEntries > 0) {
+        struct io_uring_sqe *sqe = getSqe(ring);
+        if (sqe == NULL) {
+            break;
+        }
+        SEND_FRAME *frame = dequeueSendFrame(&connection->sendQueue);
+        freeEntries--;
+
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = connection->clientSocket;
+        sqe->addr = (uint64_t) (uintptr_t) (frame->wire->data + frame->sent);
+        sqe->len = (uint32_t) (frame->wire->length - frame->sent);
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->flags = !isSendQueueEmpty(&connection->sendQueue) && freeEntries > 0 ? IOSQE_IO_LINK : 0;
+        sqe->user_data = (uint64_t) (uintptr_t) frame | URING_TAG_SEND;
+        connection->sendsInFlight++;
+        connection->bytesInFlight += frame->wire->length - frame->sent;
+        ring->sendsInFlight++;
+    }
+}
+
+static void releaseConnectionIfUnused(URING_CONNECTION *connection) {
+    // Completions still reference the connection until the receive and all sends are done
+    if (!connection->active && !connection->receiving && connection->sendsInFlight == 0) {
+        free(connection);
+    }
+}
+
+//return 1 only once, when a released connection neither receives nor sends anymore (the ring mutex has to be locked)
+static int takeFinishedRelease(URING_CONNECTION *connection) {
+    if (connection->releaseCallback == NULL || connection->released || connection->receiving
+        || connection->sendsInFlight > 0) {
+        return 0;
+    }
+    connection->released = 1;
+    return 1;
+}
+
+static void finishRelease(URING_CONNECTION *connection) {
+    URING *ring = connection->ring;
+    int clientSocket = connection->clientSocket;
+    connection->releaseCallback(clientSocket, connection->userId, &connection->received, &connection->sendQueue);
+
+    mutexLock(&ring->mutex);
+    connections[clientSocket] = NULL;
+    connection->active = 0;
+    clearSendQueue(&connection->sendQueue);
+    releaseConnectionIfUnused(connection);
+    mutexUnlock(&ring->mutex);
+
+    // The descriptor may be reused right away, so it is closed after the connection is gone
+    close(clientSocket);
+}
+
+static int ioUringSetup(unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(URING *ring, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, ring->ringFileDescriptor, toSubmit, minComplete, flags, NULL, 0);
+}
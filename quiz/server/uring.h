@@ -0,0 +1,38 @@
+/**
+ * Systemprogrammierung
+ * Multiplayer-Quiz
+ *
+ * Server
+ *
+ * uring.h: Header für das io_uring-Backend des Reactors
+ */
+#ifndef URING_H
+#define URING_H
+
+#include <sys/types.h>
+#include "reactor.h"
+
+int initUringReactors(int count, REACTOR_MESSAGE_CALLBACK messageCallback,
+                      REACTOR_DISCONNECT_CALLBACK disconnectCallback);
+
+void runUringReactor(int reactorIndex);
+
+int uringAddListener(int reactorIndex, int listenSocket, REACTOR_ACCEPT_CALLBACK acceptCallback);
+
+int uringRemoveListener(int listenSocket);
+
+int uringAddHandshake(int reactorIndex, int clientSocket, REACTOR_HANDSHAKE_CALLBACK handshakeCallback);
+
+int uringRemoveHandshake(int reactorIndex, int clientSocket);
+
+int uringAddClient(int reactorIndex, int clientSocket, int userId, /* nullable */ RECEIVE_BUFFER *received);
+
+int uringRemoveClient(int reactorIndex, int clientSocket);
+
+int uringReleaseClient(int reactorIndex, int clientSocket, REACTOR_RELEASE_CALLBACK releaseCallback);
+
+ssize_t uringSend(int reactorIndex, int clientSocket, WIRE_FRAME *wire);
+
+void uringDrain();
+
+#endif
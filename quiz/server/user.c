@@ -12,6 +12,16 @@
  * von Clients und das Iterieren über die Einträge.
  * Da diese Datenstruktur von mehreren Threads gleichzeitig verwendet wird,
  * ist auf die korrekte Synchronisierung zu achten!
+ * Die User liegen in ihrem Raum (siehe room.h) und werden mit dessen Mutex
+ * geschützt. Die ID eines Users ist nicht sein Platz: Sie wird beim Eintragen
+ * vergeben und zeigt über eine eigene Slot-Tabelle auf Raum und Platz.
+ * Die Namen eines Raumes stehen zusätzlich in einem Hash-Index, so kostet
+ * die Prüfung auf doppelte Namen beim Login O(1).
+ * Punkte werden ohne Lock gezählt, der Score-Agent sammelt sie mit
+ * collectScores() ein, bevor er die Rangliste verschickt.
+ * Leser ohne Raum-Lock sehen einen User über ein Seqlock pro Platz (getUser())
+ * oder alle Spieler über die Momentaufnahme des Raumes, die hier nach jeder
+ * Änderung neu veröffentlicht wird.
  */
 #include <stdio.h>
 #include <string.h>
@@ -22,185 +32,300 @@
 #include "vardefine.h"
 #include "score.h"
 #include "rfc.h"
+#include "room.h"
 #include "mutexhelper.h"
-
-//pthread_t
-pthread_mutex_t mutexUserData;
-
-static USER userdata[MAXUSERS];
-static unsigned int userAmount = 0; //Aktuelle anzahl angemeldeter User
-
-//reset/loescht inhalt der Zeile
-void clearUserRow(int id) {
-    lockUserData();
-
-    userdata[id].id = -1;
-    userdata[id].username[0] = '\0';
-    userdata[id].score = 0;
-    userdata[id].clientSocket = -1;
-    userAmount--;
-
-    unlockUserData();
+#include "slottable.h"
+#include "hashindex.h"
+#include "roster.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+// Where the user with the id sits, the room is -1 while the id is unused
+typedef struct {
+    int roomId;
+    int seat;
+} USER_PLACE;
+
+// Fills a player list, and the members of a roster if given, from the leaderboard
+typedef struct {
+    ROOM *room;
+    PLAYER *players;
+    ROSTER_MEMBER *members; // nullable
+    int playerCount;
+} PLAYER_LIST_BUILDER;
+
+//------------------------------------------------------------------------------
+// Method pre-declaration
+//------------------------------------------------------------------------------
+static void addPlayerToList(const LEADERBOARD_NODE *node, void *context);
+
+static int addUserToLockedRoom(ROOM *room, char *username, int socketID);
+
+//------------------------------------------------------------------------------
+// Fields
+//------------------------------------------------------------------------------
+static unsigned int totalUserAmount = 0; //Aktuelle anzahl angemeldeter User in allen Raeumen
+
+// The ids are handed out independently of the seats, the ids of users that left are used again first
+static SLOT_TABLE userPlaces;
+static pthread_mutex_t userIdMutex;
+static int *freeUserIds = NULL;
+static int freeUserIdCount = 0;
+static int freeUserIdCapacity = 0;
+static int nextUserId = 0;
+
+//------------------------------------------------------------------------------
+// Implementations
+//------------------------------------------------------------------------------
+static void initUserPlace(void *entry) {
+    ((USER_PLACE *) entry)->roomId = -1;
 }
 
-void lockUserData() {
-    mutexLock(&mutexUserData);
+//Muss vor dem ersten User aufgerufen werden, userCapacity ist die Anzahl aller Plaetze
+int initUsers(int userCapacity) {
+    if (mutexInit(&userIdMutex, NULL) < 0) {
+        errorPrint("Could not init user id MUTEX!");
+        return -1;
+    }
+    return initSlotTable(&userPlaces, userCapacity, sizeof(USER_PLACE), initUserPlace);
 }
 
-void unlockUserData() {
-    mutexUnlock(&mutexUserData);
+//gibt eine freie ID fuer den Platz, bei Fehler -1
+static int takeUserId(int roomId, int seat) {
+    mutexLock(&userIdMutex);
+    int userId = freeUserIdCount > 0 ? freeUserIds[--freeUserIdCount] : nextUserId;
+    USER_PLACE *place = reserveSlot(&userPlaces, userId);
+    if (place == NULL) {
+        if (userId != nextUserId) {
+            freeUserIdCount++;
+        }
+        mutexUnlock(&userIdMutex);
+        return -1;
+    }
+    if (userId == nextUserId) {
+        nextUserId++;
+    }
+    place->seat = seat;
+    place->roomId = roomId;
+    mutexUnlock(&userIdMutex);
+    return userId;
 }
 
-//setzt user.id=-1
-void clearUserData() {
-    for (int i = 0; i < MAXUSERS; i++) {
-        clearUserRow(i);
-        userAmount = 0;
+static void releaseUserId(int userId) {
+    mutexLock(&userIdMutex);
+    ((USER_PLACE *) getSlot(&userPlaces, userId))->roomId = -1;
+    if (freeUserIdCount == freeUserIdCapacity) {
+        int capacity = freeUserIdCapacity > 0 ? freeUserIdCapacity * 2 : SLOT_TABLE_CHUNK_SIZE;
+        int *userIds = realloc(freeUserIds, (size_t) capacity * sizeof(int));
+        if (userIds == NULL) {
+            // The id is lost, the table has room for every seat anyway
+            errorPrint("Could not keep the free user id %d", userId);
+            mutexUnlock(&userIdMutex);
+            return;
+        }
+        freeUserIds = userIds;
+        freeUserIdCapacity = capacity;
     }
+    freeUserIds[freeUserIdCount++] = userId;
+    mutexUnlock(&userIdMutex);
 }
 
-//Error: Client ID no available for user beim zweiten durchlauf
-int getUserIdByClientSocket(int clientSocket) {
-    lockUserData();
-    int clientId = -1;
+//Readers retry while the version is odd or has changed during their copy
+static void beginUserWrite(SEAT *entry) {
+    __atomic_store_n(&entry->version, entry->version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
 
-    for (int i = 0; i < MAXUSERS; i++) {
-        if (userdata[i].clientSocket == clientSocket) {
-            clientId = i;
-            break;
-        }
-    }
+static void endUserWrite(SEAT *entry) {
+    __atomic_store_n(&entry->version, entry->version + 1, __ATOMIC_RELEASE);
+}
 
-    if (clientId == -1) {
-        errorPrint("Error: Client ID not available for user");
+//Publishes the users of the room, best first, as a new roster; the room has to be locked
+static void updateRoster(ROOM *room) {
+    ROSTER *roster = createRoster(room->userAmount);
+    if (roster == NULL) {
+        errorPrint("Could not update the roster of room %d, readers keep the old one!", room->id);
+        return;
     }
-
-    unlockUserData();
-    return clientId;
+    PLAYER_LIST_BUILDER builder = {.room = room, .players = roster->players, .members = roster->members,
+                                   .playerCount = 0};
+    visitLeaderboardTop(&room->leaderboard, room->userAmount, addPlayerToList, &builder);
+    publishRoster(room, roster);
 }
 
-int initMutex() {
-    return mutexInit(&mutexUserData, NULL);
+//reset/loescht inhalt der Zeile, der Raum muss gesperrt sein
+static void clearUserRow(ROOM *room, int seat) {
+    SEAT *entry = getSeat(room, seat);
+    USER *user = &entry->user;
+    removeLeaderboardNode(&room->leaderboard, &entry->rankNode);
+    removeHashIndex(&room->nameIndex, hashString(user->username), seat);
+    releaseUserId(user->id);
+    beginUserWrite(entry);
+    user->id = -1;
+    user->username[0] = '\0';
+    user->score = 0;
+    user->clientSocket = -1;
+    endUserWrite(entry);
+    leaveSeat(room, seat);
+    __atomic_sub_fetch(&totalUserAmount, 1, __ATOMIC_RELAXED);
+    updateRoster(room);
 }
 
-//init UserData
-int initUserData() {
-    if (initMutex() >= 0) {
-        clearUserData();
-        return 1;
-    } else {
-        errorPrint("Error: Mutex could not be initialized");
+//traegt den User auf dem Platz ein, der Raum muss gesperrt sein
+//Gibt die ID des Users zurueck, bei Fehler -1
+static int fillUserRow(ROOM *room, int seat, char *username, int socketID) {
+    SEAT *entry = reserveSeat(room, seat);
+    int userId = entry != NULL ? takeUserId(room->id, seat) : -1;
+    if (userId < 0) {
+        errorPrint("Error: No memory left for user %s", username);
         return -1;
     }
+    beginUserWrite(entry);
+    strcpy(entry->user.username, username);
+    entry->user.clientSocket = socketID;
+    entry->user.score = 0;
+    entry->user.id = userId;
+    endUserWrite(entry);
+    __atomic_store_n(&entry->score.points, 0, __ATOMIC_RELAXED);
+    insertLeaderboardNode(&room->leaderboard, &entry->rankNode, 0, seat);
+    insertHashIndex(&room->nameIndex, hashString(username), seat);
+    takeSeat(room, seat);
+    __atomic_add_fetch(&totalUserAmount, 1, __ATOMIC_RELAXED);
+    updateRoster(room);
+    return userId;
 }
 
-//gibt aktuelle anzahl der angemeldeten User zurück
-int getUserAmount() {
-    return userAmount;
+//gibt den Raum des Users, -1 wenn die ID nicht vergeben ist
+int getRoomIdOfUser(int userId) {
+    USER_PLACE *place = getSlot(&userPlaces, userId);
+    return place != NULL ? place->roomId : -1;
 }
 
-//getPlayerList Sorted by Score
-//TODO shitty implementaion but works so far
-PLAYER_LIST getPlayerListSortedByScore() {
-    PLAYER_LIST allActivePlayers = getPlayerList();
-    PLAYER tmpforSwap;
-    int userAmount = getUserAmount();
-
-    //Use Bubble Sort for Sorting PlayerList
-    if (userAmount > 0) {
-        for (int i = 0; i < userAmount - 1; i++) {
-            for (int j = 0; j < userAmount - 1; j++) {
+int getSeatOfUser(int userId) {
+    USER_PLACE *place = getSlot(&userPlaces, userId);
+    return place != NULL ? place->seat : -1;
+}
 
-                if (allActivePlayers.players[i].score < allActivePlayers.players[j + 1].score) {
-                    //Swap
-                    tmpforSwap = allActivePlayers.players[j];
-                    allActivePlayers.players[j] = allActivePlayers.players[j + 1];
-                    allActivePlayers.players[j + 1] = tmpforSwap;
-                }
-            }
-        }
+//gibt aktuelle anzahl der angemeldeten User im Raum zurück
+int getUserAmount(int roomId) {
+    ROOM *room = getRoom(roomId);
+    return room != NULL ? room->userAmount : 0;
+}
 
-        for (int i = 0; i < userAmount - 1; i++) {
-            for (int j = 0; j < userAmount - 1; j++) {
+//gibt aktuelle anzahl der angemeldeten User in allen Raeumen zurück
+int getTotalUserAmount() {
+    return (int) __atomic_load_n(&totalUserAmount, __ATOMIC_RELAXED);
+}
 
-                if (allActivePlayers.players[i].score < allActivePlayers.players[j + 1].score) {
-                    //Swap
-                    tmpforSwap = allActivePlayers.players[j];
-                    allActivePlayers.players[j] = allActivePlayers.players[j + 1];
-                    allActivePlayers.players[j + 1] = tmpforSwap;
-                }
-            }
-        }
+static void addPlayerToList(const LEADERBOARD_NODE *node, void *context) {
+    PLAYER_LIST_BUILDER *builder = context;
+    USER *user = &getSeat(builder->room, node->seat)->user;
+    PLAYER *player = &builder->players[builder->playerCount++];
+    memcpy(player->name, user->username, USERNAMELENGTH);
+    player->score = user->score;
+    player->id = (uint8_t) node->seat;
+    if (builder->members != NULL) {
+        ROSTER_MEMBER *member = &builder->members[builder->playerCount - 1];
+        member->userId = user->id;
+        member->clientSocket = user->clientSocket;
     }
+}
 
-    return allActivePlayers;
+//getPlayerList Sorted by Score (bei gleichen Punkten nach Platz) aus der Rangliste des Raumes
+//Der Raum muss gesperrt sein, players muss so gross wie ein Raum sein
+int getPlayerListSortedByScore(int roomId, PLAYER *players) {
+    return getTopPlayers(roomId, players, getRoomCapacity());
 }
 
-//Returns Rank of user 1-4
-//NOTE bei gleicher Punktzahl selben platz zurueck geben
-int getAndCalculateRankByUserId(int userId) {
-    int rank = -1;
-    PLAYER_LIST sortedPlayerList = getPlayerListSortedByScore();
-    if (getUserAmount() > 0) {
-        for (int i = 0; i < getUserAmount(); i++) {
-            if (sortedPlayerList.players[i].id == userId) {
-                rank = i + 1;
-                break;
-            }
-        }
+//Die besten count Spieler in O(log n + count), der Raum muss gesperrt sein
+int getTopPlayers(int roomId, PLAYER *players, int count) {
+    ROOM *room = getRoom(roomId);
+    if (room == NULL) {
+        return 0;
     }
-    return rank;
+    PLAYER_LIST_BUILDER builder = {.room = room, .players = players, .members = NULL, .playerCount = 0};
+    visitLeaderboardTop(&room->leaderboard, count, addPlayerToList, &builder);
+    return builder.playerCount;
 }
 
-PLAYER_LIST getPlayerList() {
-    PLAYER_LIST allActivePlayers;
-
-    if (getUserAmount() > 0) {
-        int nextSlot = 0;
-        for (int i = 0; i < getUserAmount(); i++) {
+//Returns Rank of user 1-n in O(log n), der Raum muss gesperrt sein
+//bei gleicher Punktzahl selben platz zurueck geben
+int getAndCalculateRankByUserId(int userId) {
+    ROOM *room = getRoom(getRoomIdOfUser(userId));
+    if (room == NULL) {
+        return -1;
+    }
+    return getLeaderboardRank(&room->leaderboard, getSeat(room, getSeatOfUser(userId))->user.score);
+}
 
-            for (int j = nextSlot; j < MAXUSERS; j++) {
-                PLAYER activePlayer;
+//Die IDs in der Liste sind die Plaetze im Raum, players muss so gross wie ein Raum sein
+//Gibt die Anzahl der Spieler zurueck
+int getPlayerList(int roomId, PLAYER *players) {
+    USER_ITERATOR iterator;
+    startUserIteration(&iterator, roomId);
+
+    int nextPlayer = 0;
+    USER *user;
+    while ((user = nextUser(&iterator)) != NULL) {
+        PLAYER *activePlayer = &players[nextPlayer++];
+        memcpy(activePlayer->name, user->username, USERNAMELENGTH);
+        activePlayer->score = user->score;
+        activePlayer->id = (uint8_t) getSeatOfUser(user->id);
+    }
 
-                if (userdata[j].id != -1) {
-                    memcpy(activePlayer.name, userdata[j].username, USERNAMELENGTH);
-                    activePlayer.score = userdata[j].score;
-                    activePlayer.id = userdata[j].id;
+    return nextPlayer;
+}
 
-                    allActivePlayers.players[i] = activePlayer;
-                    nextSlot = j;
-                    j = MAXUSERS;
-                }
-                nextSlot++;
-            }
-        }
+//Hinzufuegen eines Users in den offenen Raum
+//Gibt die ID des Users zurueck, bei Fehler => < 0
+int addUser(char *username, int socketID) {
+    if (strlen(username) >= USERNAMELENGTH) {
+        errorPrint("Username to long!");
+        return -1;
     }
 
-    return allActivePlayers;
-}
+    int roomId = lockOpenRoom();
+    if (roomId < 0) {
+        errorPrint("Error: All rooms are taken, adding Username: %s not possible!", username);
 
-//gibt den Index des freien Speicherplatzes in userdata
-//Bei fehler -1
-static int getFreeSlotID() {
-    for (int i = 0; i < MAXUSERS; i++) {
-        if (userdata[i].id == -1) {
-            return i;
+        MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL,
+                                                 "Maximum numbers of User reached, adding Username not possible!");
+        if (sendMessage(socketID, &errorWarning) < 0) {
+            errorPrint("Unable to send error warning to");
         }
+        return -3;
     }
-    return -1;
-}
 
-//Hinzufuegen eines Users
-//Bei Fehler => -1
-int addUser(char *username, int socketID) {
-    lockUserData();
+    // The open room always has a free seat
+    return addUserToLockedRoom(getRoom(roomId), username, socketID);
+}
 
-    if (strlen(username) > USERNAMELENGTH) {
+//Hinzufuegen eines Users in den Raum, den das Matchmaking fuer seine Gruppe eroeffnet hat
+//Gibt die ID des Users zurueck, bei Fehler => < 0
+int addMatchedUser(int roomId, char *username, int socketID) {
+    if (strlen(username) >= USERNAMELENGTH) {
         errorPrint("Username to long!");
         return -1;
     }
 
-    if (nameExist(username) != 0) {
+    lockRoom(roomId);
+    ROOM *room = getRoom(roomId);
+    if (room->gameState != GAME_STATE_PREPARATION || getFreeSeat(room) < 0) {
+        errorPrint("Error: Room %d of the match is not open anymore, adding Username: %s not possible!", roomId,
+                   username);
+        unlockRoom(roomId);
+        return -3;
+    }
+
+    return addUserToLockedRoom(room, username, socketID);
+}
+
+//Setzt den User auf den naechsten freien Platz, der Raum muss gesperrt sein und hat einen freien Platz
+//Entsperrt den Raum, gibt die ID des Users zurueck, bei Fehler => < 0
+static int addUserToLockedRoom(ROOM *room, char *username, int socketID) {
+    int roomId = room->id;
+    if (nameExist(roomId, username) != 0) {
         errorPrint("Error: User with Username: %s already exist!", username);
 
         MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL, "User with Username already exist!");
@@ -208,98 +333,99 @@ int addUser(char *username, int socketID) {
             errorPrint("Unable to send error warning to");
         }
 
-        unlockUserData();
+        unlockRoom(roomId);
         return -2;
     }
 
-    if (getUserAmount() >= MAXUSERS) {
-        errorPrint("Error: Maximum numbers of User reached, adding Username: %s not possible!", username);
-
-        MESSAGE errorWarning = buildErrorWarning(ERROR_WARNING_TYPE_FATAL,
-                                                 "Maximum numbers of User reached, adding Username not possible!");
-        if (sendMessage(socketID, &errorWarning) < 0) {
-            errorPrint("Unable to send error warning to");
-        }
+    int userId = fillUserRow(room, getFreeSeat(room), username, socketID);
 
-        unlockUserData();
-        return -3;
+    unlockRoom(roomId);
+    if (userId < 0) {
+        releaseRoomIfEmpty(roomId);
+        return -4;
     }
 
-    int freeSlot = getFreeSlotID();
-    if (freeSlot < 0) {
-        errorPrint("Error: No free slot");
-        unlockUserData();
-        return -4;
+    return userId;
+}
+
+//Traegt einen vom vorherigen Server uebernommenen User auf seinem bisherigen Platz ein
+//Gibt die neue ID zurueck, bei Fehler (z.B. Platz schon vergeben) => -1
+int restoreUser(int roomId, int seat, char *username, int socketID) {
+    if (seat < 0 || seat >= getRoomCapacity() || lockRoomForRestore(roomId) < 0) {
+        return -1;
     }
+    ROOM *room = getRoom(roomId);
 
-    userdata[freeSlot].id = freeSlot;
-    strcpy(userdata[freeSlot].username, username);
-    userdata[freeSlot].clientSocket = socketID;
-    userdata[freeSlot].score = 0;
-    userAmount++;
+    SEAT *entry = getSeat(room, seat);
+    int userId = -1;
+    if ((entry == NULL || entry->user.id == -1) && strlen(username) < USERNAMELENGTH
+        && nameExist(roomId, username) == 0) {
+        userId = fillUserRow(room, seat, username, socketID);
+    }
 
-    unlockUserData();
+    unlockRoom(roomId);
+    if (userId < 0) {
+        releaseRoomIfEmpty(roomId);
+    }
 
-    return 1;
+    return userId;
 }
 
+//Needs no lock, the copy is consistent even while the seat changes
 USER getUser(int userId) {
-    return userdata[userId];
+    ROOM *room = getRoom(getRoomIdOfUser(userId));
+    SEAT *entry = room != NULL ? getSeat(room, getSeatOfUser(userId)) : NULL;
+    if (entry == NULL) {
+        USER noUser = {.id = -1, .clientSocket = -1};
+        return noUser;
+    }
+
+    USER user;
+    unsigned int version;
+    do {
+        version = __atomic_load_n(&entry->version, __ATOMIC_ACQUIRE);
+        memcpy(&user, &entry->user, sizeof(USER));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((version & 1) != 0 || version != __atomic_load_n(&entry->version, __ATOMIC_RELAXED));
+    return user;
 }
 
-USER getUserByIndex(int index) {
-    // Implementation may be irritating, but we should implement this as we are able to
-    // separate the index and the id in the future.
-    // Doing so we could handle the disconnect of the leader (id: 0) to still get the first connected
-    // user by index.
-    for (int i = 0; i < MAXUSERS; i++) {
-        if (getUser(i).id == -1) {
-            index++;
-        }
-        if (i >= index) {
-            break;
-        }
-    }
-    return getUser(index);
+//return 1 if the user still uses the socket, a roster may name users that have left meanwhile
+int isUserOnSocket(int userId, int clientSocket) {
+    return getUser(userId).clientSocket == clientSocket;
 }
 
 int getSocketIdByUserId(int userId) {
-    return userdata[userId].clientSocket;
+    return getUser(userId).clientSocket;
 }
 
-//return 1 => true
-//return 0 => false
-int nameExist(char *username) {
-
-    for (int i = 0; i < MAXUSERS; i++) {
-        if (strcmp(userdata[i].username, username) == 0) {
-            return 1;
-        }
-    }
-
-    return 0;
+static int isNameOfSeat(int seat, const void *username, void *room) {
+    return strcmp(getSeat(room, seat)->user.username, username) == 0;
 }
 
-//loescht ein User anhand der socketID
-void removeUserOverSocketID(int socketID) {
-    for (int i = 0; i < MAXUSERS; i++) {
-        if (userdata[i].clientSocket == socketID) {
-            clearUserRow(i);
-            notifyScoreAgent(); //for ScoreAgent to be executed
-        }
-    }
+//der Raum muss gesperrt sein
+//return 1 => true
+//return 0 => false
+int nameExist(int roomId, char *username) {
+    ROOM *room = getRoom(roomId);
+    return findHashIndex(&room->nameIndex, hashString(username), isNameOfSeat, username, room) != -1;
 }
 
-//loescht ein User anhand der ID
+//loescht ein User anhand der ID, ein leerer Raum wird wieder frei
 void removeUser(int userId) {
-    clearUserRow(userId);
-    notifyScoreAgent(); //for ScoreAgent to be executed
+    int roomId = getRoomIdOfUser(userId);
+    lockRoom(roomId);
+    clearUserRow(getRoom(roomId), getSeatOfUser(userId));
+    unlockRoom(roomId);
+
+    notifyScoreAgent(roomId); //for ScoreAgent to be executed
+    releaseRoomIfEmpty(roomId);
 }
 
 //0 => ja
 //-1=> nein
 int isGameLeader(int userId) {
-    if (userId == 0) {
+    if (getSeatOfUser(userId) == 0) {
         return 0;
     } else {
         return -1;
@@ -319,48 +445,58 @@ void calcScoreForUserByID(long timeout, long neededtime, int id) {
 
     unsigned int scoreForCurrentQuestion = scoreForTimeLeft(timeout, (timeout - neededtime));
 
-    lockUserData();
-    for (int i = 0; i < MAXUSERS; i++) {
-        if (userdata[i].id == id) {
-            userdata[i].score += scoreForCurrentQuestion;
-        }
+    // Only the counter of the seat is touched, collectScores() moves the points to the leaderboard later
+    ROOM *room = getRoom(getRoomIdOfUser(id));
+    SEAT *entry = room != NULL ? getSeat(room, getSeatOfUser(id)) : NULL;
+    if (entry != NULL) {
+        __atomic_add_fetch(&entry->score.points, scoreForCurrentQuestion, __ATOMIC_RELEASE);
     }
-    unlockUserData();
-
 }
 
-//DEBUG print UserData
-void printUSERDATA() {
-    debugPrint("/---------------------------------------------------------------\\");
-    for (int i = 0; i < MAXUSERS; i++) {
-        debugPrint("| ID:  %d\t| Username: %s\t| score: %d\t| SocketID:%d\t|", userdata[i].id, userdata[i].username,
-                   userdata[i].score, userdata[i].clientSocket);
+//Takes the counted points of all players into their users and the leaderboard, the room has to be locked
+void collectScores(int roomId) {
+    ROOM *room = getRoom(roomId);
+    USER_ITERATOR iterator;
+    startUserIteration(&iterator, roomId);
+    USER *user;
+    int changed = 0;
+    while ((user = nextUser(&iterator)) != NULL) {
+        SEAT *entry = getSeat(room, getSeatOfUser(user->id));
+        unsigned int points = __atomic_load_n(&entry->score.points, __ATOMIC_ACQUIRE);
+        if (points != user->score) {
+            beginUserWrite(entry);
+            user->score = points;
+            endUserWrite(entry);
+            updateLeaderboardScore(&room->leaderboard, &entry->rankNode, points);
+            changed = 1;
+        }
+    }
+    if (changed) {
+        updateRoster(room);
     }
-    debugPrint("\\---------------------------------------------------------------/");
 }
 
-void printPlayerList() {
-    PLAYER_LIST tmpPlayerLst = getPlayerList();
-
-    debugPrint("/------------------------PLAYER-LIST----------------------------\\");
-    for (int i = 0; i < getUserAmount(); i++) {
-        debugPrint("| ID:  %d\t| Username: %s\t| score: %d\t|", tmpPlayerLst.players[i].id,
-                   tmpPlayerLst.players[i].name,
-                   tmpPlayerLst.players[i].score);
+//Sets the points of all players back to 0 for the next game, the room has to be locked
+void resetScores(int roomId) {
+    ROOM *room = getRoom(roomId);
+    USER_ITERATOR iterator;
+    startUserIteration(&iterator, roomId);
+    USER *user;
+    while ((user = nextUser(&iterator)) != NULL) {
+        __atomic_store_n(&getSeat(room, getSeatOfUser(user->id))->score.points, 0, __ATOMIC_RELAXED);
     }
-    debugPrint("\\---------------------------------------------------------------/");
+    collectScores(roomId);
 }
 
-void printPlayerListSortedByScore() {
-    PLAYER_LIST tmpPlayerLst = getPlayerListSortedByScore();
-
-    debugPrint("/----------------PLAYER-LIST-sorted by Score--------------------\\");
-    for (int i = 0; i < getUserAmount(); i++) {
-        debugPrint("| ID:  %d\t| Username: %s\t| score: %d\t|", tmpPlayerLst.players[i].id,
-                   tmpPlayerLst.players[i].name,
-                   tmpPlayerLst.players[i].score);
+//DEBUG print UserData, nur belegte Plaetze, aus der Momentaufnahme des Raumes
+void printUSERDATA(int roomId) {
+    ROSTER *roster = acquireRoster(roomId);
+    debugPrint("/----------------------------ROOM %d-----------------------------\\", roomId);
+    for (int i = 0; roster != NULL && i < roster->playerCount; i++) {
+        debugPrint("| ID:  %d\t| Seat: %d\t| Username: %s\t| score: %u\t| SocketID:%d\t|", roster->members[i].userId,
+                   roster->players[i].id, roster->players[i].name, roster->players[i].score,
+                   roster->members[i].clientSocket);
     }
+    releaseRoster(roster);
     debugPrint("\\---------------------------------------------------------------/");
 }
-
-
@@ -20,48 +20,50 @@ typedef struct user {
     int clientSocket; //Socket-Deskriptor
 } USER;
 
-int initUserData();
+int initUsers(int userCapacity);
+
+int getRoomIdOfUser(int userId);
+
+int getSeatOfUser(int userId);
 
 int addUser(char *username, int socketID);
 
-void removeUserOverSocketID(int socketID);
+int addMatchedUser(int roomId, char *username, int socketID);
+
+int restoreUser(int roomId, int seat, char *username, int socketID);
 
 void removeUser(int userId);
 
 USER getUser(int userId);
 
-USER getUserByIndex(int index);
+int isUserOnSocket(int userId, int clientSocket);
 
 int getSocketIdByUserId(int userId);
 
-int getUserAmount();
+int getUserAmount(int roomId);
 
-int getUserIdByClientSocket(int clientSocket);
+int getTotalUserAmount();
 
-void clearUserData();
-
-int nameExist(char *username);
+int nameExist(int roomId, char *username);
 
 int isGameLeader(int userId);
 
-PLAYER_LIST getPlayerList();
-
-PLAYER_LIST getPlayerListSortedByScore();
+int getPlayerList(int roomId, PLAYER *players);
 
-void lockUserData();
+int getPlayerListSortedByScore(int roomId, PLAYER *players);
 
-void unlockUserData();
+int getTopPlayers(int roomId, PLAYER *players, int count);
 
 //Calc score for the user given, question timeout, needed time to answer, and clientSocket
 void calcScoreForUserByID(long timeout, long neededtime, int id);
 
-int getAndCalculateRankByUserId(int userId);
+void collectScores(int roomId);
 
-//Debug functions
-void printUSERDATA();
+void resetScores(int roomId);
 
-void printPlayerList();
+int getAndCalculateRankByUserId(int userId);
 
-void printPlayerListSortedByScore();
+//Debug functions
+void printUSERDATA(int roomId);
 
 #endif
@@ -5,92 +5,160 @@
  * Server
  *
  * usertimer.c: Implementierung zur Verwaltung von Timern für Benutzer
+ *
+ * Neben dem Timer jedes Benutzers gibt es einen Timer pro Raum, der im Modus
+ * mit synchronen Runden die Frist der Frage für alle Spieler des Raumes setzt.
  */
 #include <sys/types.h>
 #include <signal.h>
 #include <time.h>
+#include <stdlib.h>
 #include "../common/util.h"
 #include "vardefine.h"
+#include "slottable.h"
+
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+typedef struct {
+    timer_t timer; // NULL until the user (or room) gets the first question
+    void (*callback)(int);
+    int id; // The user or room id the callback gets
+} USER_TIMER;
 
 //------------------------------------------------------------------------------
 // Method pre-declarations
 //------------------------------------------------------------------------------
-static void callTimerCallback(int sig, siginfo_t *si, void *uc);
+static int startTableTimer(SLOT_TABLE *table, int id, int durationSeconds, void (*timerCallback)(int));
+
+static int stopTableTimer(SLOT_TABLE *table, int id);
+
+static long getTableMillisLeft(SLOT_TABLE *table, int id);
+
+static void callTimerCallback(union sigval value);
 
 //------------------------------------------------------------------------------
 // Fields
 //------------------------------------------------------------------------------
-static timer_t timers[MAXUSERS] = {NULL};
+// One timer per user id of all rooms, the table only grows as far as ids are used
+static SLOT_TABLE timers;
 
-static void (*timerCallbacks[MAXUSERS])(int);
+// One timer per room for the synchronized rounds
+static SLOT_TABLE roomTimers;
 
 //------------------------------------------------------------------------------
 // Implementations
 //------------------------------------------------------------------------------
+int initUserTimers(int userCapacity) {
+    if (initSlotTable(&timers, userCapacity, sizeof(USER_TIMER), NULL) < 0) {
+        errorPrint("Unable to allocate the user timers!");
+        return -1;
+    }
+    return 0;
+}
+
+int initRoomTimers(int maxRooms) {
+    if (initSlotTable(&roomTimers, maxRooms, sizeof(USER_TIMER), NULL) < 0) {
+        errorPrint("Unable to allocate the room timers!");
+        return -1;
+    }
+    return 0;
+}
+
 int startTimer(int userId, int durationSeconds, void (*timerCallback)(int)) {
+    return startTableTimer(&timers, userId, durationSeconds, timerCallback);
+}
+
+int stopTimer(int userId) {
+    return stopTableTimer(&timers, userId);
+}
+
+long getDurationMillisLeft(int userId) {
+    return getTableMillisLeft(&timers, userId);
+}
+
+int startRoomTimer(int roomId, int durationSeconds, void (*timerCallback)(int)) {
+    return startTableTimer(&roomTimers, roomId, durationSeconds, timerCallback);
+}
+
+int stopRoomTimer(int roomId) {
+    return stopTableTimer(&roomTimers, roomId);
+}
+
+long getRoomMillisLeft(int roomId) {
+    return getTableMillisLeft(&roomTimers, roomId);
+}
+
+//The slots of a table never move, so the timer event points to its slot
+static int startTableTimer(SLOT_TABLE *table, int id, int durationSeconds, void (*timerCallback)(int)) {
+    USER_TIMER *userTimer = reserveSlot(table, id);
+    if (userTimer == NULL) {
+        errorPrint("Unable to allocate the timer for %d!", id);
+        return -1;
+    }
+
     // Store the timer callback for later use
-    timerCallbacks[userId] = timerCallback;
+    userTimer->callback = timerCallback;
+    userTimer->id = id;
 
     // If the timer was not created yet, start it
-    if (timers[userId] == NULL) {
-        // Setup the signal action (calling the callback handler)
-        struct sigaction action;
-        action.sa_flags = SA_SIGINFO;
-        action.sa_sigaction = callTimerCallback;
-        sigemptyset(&action.sa_mask);
-        if (sigaction(SIGRTMIN, &action, NULL) < 0) {
-            errorPrint("Unable to create signal action for timer for user %d!", userId);
-            return -1;
-        }
-        debugPrint("Created signal action for timer for user %d", userId);
-
+    if (userTimer->timer == NULL) {
         // Create the event for the timer callback
-        struct sigevent event;
-        event.sigev_signo = SIGRTMIN;
-        event.sigev_notify = SIGEV_SIGNAL;
-        event.sigev_value.sival_int = userId;
-        if (timer_create(CLOCK_REALTIME, &event, &timers[userId]) < 0) {
-            errorPrint("Unable to create timer with sigevent for user %d!", userId);
+        // The callback runs in its own thread and not in a signal handler, because it sends
+        // messages and therefore needs to take locks (e.g. of the io_uring reactor)
+        struct sigevent event = {0};
+        event.sigev_notify = SIGEV_THREAD;
+        event.sigev_notify_function = callTimerCallback;
+        event.sigev_value.sival_ptr = userTimer;
+        if (timer_create(CLOCK_REALTIME, &event, &userTimer->timer) < 0) {
+            errorPrint("Unable to create timer with sigevent for %d!", id);
             return -2;
         }
-        debugPrint("Created timer with sigevent for user %d", userId);
+        debugPrint("Created timer with sigevent for %d", id);
     }
 
     // Start the timer
     // Initialize the timer with 0, because else it is sometime not able to start
     struct itimerspec countdown = {0};
     countdown.it_value.tv_sec = durationSeconds;
-    if (timer_settime(timers[userId], 0, &countdown, NULL) < 0) {
-        errorPrint("Unable to start timer with sigevent for user %d!", userId);
+    if (timer_settime(userTimer->timer, 0, &countdown, NULL) < 0) {
+        errorPrint("Unable to start timer with sigevent for %d!", id);
         return -3;
     }
 
-    debugPrint("Started timer for user %d", userId);
+    debugPrint("Started timer for %d", id);
     return 0;
 }
 
-int stopTimer(int userId) {
+static int stopTableTimer(SLOT_TABLE *table, int id) {
+    // A user that never got a question has no timer to stop
+    USER_TIMER *userTimer = getSlot(table, id);
+    if (userTimer == NULL || userTimer->timer == NULL) {
+        return 0;
+    }
+
     // Stop the timer by removing the countdown
     struct itimerspec countdown = {0};
-    if (timer_settime(timers[userId], 0, &countdown, NULL) < 0) {
-        errorPrint("Unable to stop the timer for user %d!", userId);
+    if (timer_settime(userTimer->timer, 0, &countdown, NULL) < 0) {
+        errorPrint("Unable to stop the timer for %d!", id);
         return -1;
     }
 
-    debugPrint("Stopped timer for user %d", userId);
+    debugPrint("Stopped timer for %d", id);
     return 0;
 }
 
-long getDurationMillisLeft(int userId) {
+static long getTableMillisLeft(SLOT_TABLE *table, int id) {
+    USER_TIMER *userTimer = getSlot(table, id);
     struct itimerspec countdown;// = {0};
-    if (timer_gettime(timers[userId], &countdown) < 0) {
-        errorPrint("Could not get remaining time from timer for user %d!", userId);
+    if (userTimer == NULL || userTimer->timer == NULL || timer_gettime(userTimer->timer, &countdown) < 0) {
+        errorPrint("Could not get remaining time from timer for %d!", id);
         return -1;
     }
     return countdown.it_value.tv_sec * 1000 + countdown.it_value.tv_nsec / 10000000;
 }
 
-static void callTimerCallback(int sig, siginfo_t *si, void *uc) {
-    int userId = si->si_value.sival_int;
-    timerCallbacks[userId](userId);
+static void callTimerCallback(union sigval value) {
+    USER_TIMER *userTimer = value.sival_ptr;
+    userTimer->callback(userTimer->id);
 }
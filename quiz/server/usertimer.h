@@ -9,10 +9,20 @@
 #ifndef USERTIMER_H
 #define USERTIMER_H
 
+int initUserTimers(int userCapacity);
+
 int startTimer(int userId, int durationSeconds, void (*timerCallback)(int));
 
 int stopTimer(int userId);
 
 long getDurationMillisLeft(int userId);
 
+int initRoomTimers(int maxRooms);
+
+int startRoomTimer(int roomId, int durationSeconds, void (*timerCallback)(int));
+
+int stopRoomTimer(int roomId);
+
+long getRoomMillisLeft(int roomId);
+
 #endif
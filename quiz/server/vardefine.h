@@ -5,11 +5,16 @@
 #ifndef SYSPROG_VARDEFINE_H
 #define SYSPROG_VARDEFINE_H
 
-#define MAXCONNECTIONS 4
+#define DEFAULTLISTENBACKLOG 128
+#define DEFAULTWAITINGCONNECTIONS 64
+#define DEFAULTMAXCONNECTIONS 256
+#define DEFAULTMAXROOMS 64
 #define MAXDATASIZE 1024
-#define MAXUSERS 4
+#define DEFAULTROOMCAPACITY 4
 #define MINUSERS 2
+#define DEFAULTMATCHWAITSECONDS 10
 #define USERNAMELENGTH 32
+#define MAXSENDQUEUEBYTES (64 * 1024)
 
 #endif //SYSPROG_VARDEFINE_H
 